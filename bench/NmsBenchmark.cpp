@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "darknet.h"
+
+#include "NonMaximumSuppression.hpp"
+
+/**
+ * Compares NonMaximumSuppression with darknet's do_nms_sort on random candidate boxes
+ */
+
+namespace
+{
+
+const int networksize = 608;
+const int classes = 80;
+const int iterations = 20;
+const float threshold = 0.4f;
+
+/**
+ * Returns average time of a single call in milliseconds, setup is not measured
+ */
+double measure(const std::function<void()>& setup, const std::function<void()>& function)
+{
+  setup();
+  function();
+  std::chrono::duration<double, std::milli> elapsed {0.0};
+  for (int i = 0; i < iterations; i++)
+  {
+    setup();
+    auto start = std::chrono::steady_clock::now();
+    function();
+    elapsed += std::chrono::steady_clock::now() - start;
+  }
+  return elapsed.count() / iterations;
+}
+
+/**
+ * Clustered boxes, as produced by a detector on a dense scene
+ */
+std::vector<bbox_t> randomBoxes(int count, std::mt19937& generator)
+{
+  std::uniform_int_distribution<int> centers(0, networksize - 1);
+  std::uniform_int_distribution<int> sizes(16, 160);
+  std::normal_distribution<float> jitter(0.0f, 6.0f);
+  std::uniform_int_distribution<int> classids(0, 7);
+  std::uniform_real_distribution<float> probabilities(0.2f, 1.0f);
+  std::vector<bbox_t> boxes;
+  while (static_cast<int>(boxes.size()) < count)
+  {
+    int cx = centers(generator), cy = centers(generator), w = sizes(generator), h = sizes(generator);
+    unsigned int classid = classids(generator);
+    for (int i = 0; i < 8 && static_cast<int>(boxes.size()) < count; i++)
+    {
+      bbox_t box {};
+      box.w = std::max(1, static_cast<int>(w + jitter(generator)));
+      box.h = std::max(1, static_cast<int>(h + jitter(generator)));
+      box.x = std::max(0, static_cast<int>(cx + jitter(generator)) - static_cast<int>(box.w) / 2);
+      box.y = std::max(0, static_cast<int>(cy + jitter(generator)) - static_cast<int>(box.h) / 2);
+      box.prob = probabilities(generator);
+      box.obj_id = classid;
+      boxes.push_back(box);
+    }
+  }
+  return boxes;
+}
+
+/**
+ * Writes the boxes as darknet detections in relative center coordinates
+ */
+void toDetections(const std::vector<bbox_t>& boxes, std::vector<detection>& detections, std::vector<float>& probabilities)
+{
+  detections.assign(boxes.size(), detection {});
+  probabilities.assign(boxes.size() * classes, 0.0f);
+  for (size_t i = 0; i < boxes.size(); i++)
+  {
+    const bbox_t& box = boxes[i];
+    detection& d = detections[i];
+    d.bbox.x = (box.x + box.w / 2.0f) / networksize;
+    d.bbox.y = (box.y + box.h / 2.0f) / networksize;
+    d.bbox.w = static_cast<float>(box.w) / networksize;
+    d.bbox.h = static_cast<float>(box.h) / networksize;
+    d.classes = classes;
+    d.prob = &probabilities[i * classes];
+    d.prob[box.obj_id] = box.prob;
+    d.objectness = box.prob;
+  }
+}
+
+size_t keptDetections(const std::vector<detection>& detections)
+{
+  size_t kept = 0;
+  for (const detection& d : detections)
+  {
+    for (int c = 0; c < classes; c++)
+    {
+      if (d.prob[c] > 0.0f)
+      {
+        kept++;
+        break;
+      }
+    }
+  }
+  return kept;
+}
+
+}
+
+int main()
+{
+  std::mt19937 generator(42);
+  NonMaximumSuppression scalar(false);
+  NonMaximumSuppression simd(true);
+  NmsSettings classaware;
+  classaware.iouthreshold = threshold;
+  NmsSettings agnostic = classaware;
+  agnostic.classaware = false;
+  NmsSettings soft = classaware;
+  soft.soft = true;
+
+  std::cout << classes << " classes, IoU threshold " << threshold << ", " << iterations
+    << " iterations, SIMD kernel: " << simd.kernelName() << std::endl << std::endl;
+
+  for (int count : {100, 500, 1000, 2000, 5000})
+  {
+    std::vector<bbox_t> boxes = randomBoxes(count, generator);
+    std::vector<bbox_t> objects;
+    std::vector<detection> detections;
+    std::vector<float> probabilities;
+
+    double darknet = measure([&] { toDetections(boxes, detections, probabilities); },
+        [&] { do_nms_sort(detections.data(), static_cast<int>(detections.size()), classes, threshold); });
+    size_t darknetkept = keptDetections(detections);
+    double awarescalar = measure([&] { objects = boxes; }, [&] { scalar.run(objects, classaware); });
+    double awaresimd = measure([&] { objects = boxes; }, [&] { simd.run(objects, classaware); });
+    size_t awarekept = objects.size();
+    double agnosticsimd = measure([&] { objects = boxes; }, [&] { simd.run(objects, agnostic); });
+    size_t agnostickept = objects.size();
+    double softsimd = measure([&] { objects = boxes; }, [&] { simd.run(objects, soft); });
+
+    std::cout << count << " boxes" << std::endl;
+    std::cout << "  darknet do_nms_sort " << darknet << " ms, kept " << darknetkept << std::endl;
+    std::cout << "  per class: scalar " << awarescalar << " ms, " << simd.kernelName() << " " << awaresimd
+      << " ms (" << darknet / awaresimd << "x), kept " << awarekept << std::endl;
+    std::cout << "  all classes: " << simd.kernelName() << " " << agnosticsimd << " ms, kept " << agnostickept << std::endl;
+    std::cout << "  soft per class: " << simd.kernelName() << " " << softsimd << " ms" << std::endl;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,117 @@
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "NetworkInput.hpp"
+
+/**
+ * Compares the fused preprocessing kernel with the resize, cvtColor and
+ * per-pixel float conversion chain used by Detector::detect(cv::Mat)
+ */
+
+namespace
+{
+
+const cv::Size networksize {608, 608};
+const int iterations = 50;
+
+/**
+ * Returns average time of a single call in milliseconds
+ */
+double measure(const std::function<void()>& function)
+{
+  function();
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++)
+  {
+    function();
+  }
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / iterations;
+}
+
+/**
+ * Same steps as Detector::mat_to_image_resize followed by mat_to_image_custom
+ */
+void darknetChain(const cv::Mat& bgr, cv::Mat& resized, cv::Mat& rgb, std::vector<float>& destination)
+{
+  cv::resize(bgr, resized, networksize);
+  cv::cvtColor(resized, rgb, cv::COLOR_RGB2BGR);
+  const int width = rgb.cols;
+  const int height = rgb.rows;
+  const int channels = rgb.channels();
+  const unsigned char* data = rgb.data;
+  for (int y = 0; y < height; y++)
+  {
+    for (int c = 0; c < channels; c++)
+    {
+      for (int x = 0; x < width; x++)
+      {
+        destination[c * width * height + y * width + x] = data[y * rgb.step + x * channels + c] / 255.0f;
+      }
+    }
+  }
+}
+
+double maxDifference(const std::vector<float>& first, const std::vector<float>& second)
+{
+  double difference = 0.0;
+  for (size_t i = 0; i < first.size(); i++)
+  {
+    difference = std::max(difference, static_cast<double>(std::abs(first[i] - second[i])));
+  }
+  return difference;
+}
+
+}
+
+int main()
+{
+  const std::vector<std::pair<const char*, cv::Size>> resolutions = {
+    {"720p", {1280, 720}},
+    {"1080p", {1920, 1080}},
+    {"4K", {3840, 2160}}
+  };
+
+  FusedPreprocessor scalar(networksize, false);
+  FusedPreprocessor simd(networksize, true);
+  std::vector<float> reference(3 * networksize.area());
+  std::vector<float> output(3 * networksize.area());
+  cv::Mat resized, rgb;
+
+  std::cout << "network input " << networksize.width << " x " << networksize.height
+    << ", " << iterations << " iterations, SIMD kernel: " << simd.kernelName() << std::endl << std::endl;
+
+  for (const auto& [name, size] : resolutions)
+  {
+    cv::Mat bgr(size, CV_8UC3);
+    cv::randu(bgr, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::Mat nv12(size.height * 3 / 2, size.width, CV_8UC1);
+    cv::randu(nv12, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::Mat nv12bgr;
+
+    double chain = measure([&] { darknetChain(bgr, resized, rgb, reference); });
+    double fusedscalar = measure([&] { scalar.run(bgr, PixelFormat::BGR, false, output.data()); });
+    double fusedsimd = measure([&] { simd.run(bgr, PixelFormat::BGR, false, output.data()); });
+    double difference = maxDifference(reference, output);
+
+    double nv12chain = measure([&] {
+        cv::cvtColor(nv12, nv12bgr, cv::COLOR_YUV2BGR_NV12);
+        darknetChain(nv12bgr, resized, rgb, reference);
+    });
+    double nv12scalar = measure([&] { scalar.run(nv12, PixelFormat::NV12, false, output.data()); });
+    double nv12simd = measure([&] { simd.run(nv12, PixelFormat::NV12, false, output.data()); });
+
+    std::cout << name << " (" << size.width << " x " << size.height << ")" << std::endl;
+    std::cout << "  BGR:  chain " << chain << " ms, fused scalar " << fusedscalar << " ms, fused "
+      << simd.kernelName() << " " << fusedsimd << " ms (" << chain / fusedsimd << "x), max difference "
+      << difference << std::endl;
+    std::cout << "  NV12: chain " << nv12chain << " ms, fused scalar " << nv12scalar << " ms, fused "
+      << simd.kernelName() << " " << nv12simd << " ms (" << nv12chain / nv12simd << "x)" << std::endl;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,137 @@
+#include "ClassFilter.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+
+namespace
+{
+std::string lowercase(std::string text)
+{
+  std::transform(text.begin(), text.end(), text.begin(),
+          [](unsigned char c){ return std::tolower(c); }
+  );
+  return text;
+}
+
+std::string trim(const std::string& text)
+{
+  size_t first = text.find_first_not_of(' ');
+  if (first == std::string::npos)
+  {
+    return "";
+  }
+  size_t last = text.find_last_not_of(' ');
+  return text.substr(first, last - first + 1);
+}
+}
+
+void ClassFilter::setNames(const std::vector<std::string>& names)
+{
+  lowercasenames.clear();
+  for (const std::string& name : names)
+  {
+    lowercasenames.push_back(lowercase(name));
+  }
+  classcount = names.size();
+  bits.assign((classcount + 63) / 64, ~uint64_t(0));
+  source.clear();
+  maskversion++;
+}
+
+bool ClassFilter::compile(const std::string& text)
+{
+  if (text == source)
+  {
+    return false;
+  }
+  source = text;
+
+  std::vector<Term> terms;
+  std::stringstream stream(text);
+  std::string term;
+  while (std::getline(stream, term, ','))
+  {
+    Term parsed = parseTerm(term);
+    if (!parsed.text.empty())
+    {
+      terms.push_back(parsed);
+    }
+  }
+  bool anyincluding = std::any_of(terms.begin(), terms.end(), [](const Term& t) { return !t.negated; });
+
+  std::vector<uint64_t> compiled((classcount + 63) / 64, 0);
+  for (size_t classid = 0; classid < classcount; classid++)
+  {
+    const std::string& name = lowercasenames[classid];
+    bool included = !anyincluding;
+    bool excluded = false;
+    for (const Term& t : terms)
+    {
+      if (matches(t, name))
+      {
+        included = included || !t.negated;
+        excluded = excluded || t.negated;
+      }
+    }
+    if (included && !excluded)
+    {
+      compiled[classid / 64] |= uint64_t(1) << (classid % 64);
+    }
+  }
+
+  if (compiled == bits)
+  {
+    return false;
+  }
+  bits = std::move(compiled);
+  maskversion++;
+  return true;
+}
+
+const std::vector<uint64_t>& ClassFilter::mask() const
+{
+  return bits;
+}
+
+uint64_t ClassFilter::version() const
+{
+  return maskversion;
+}
+
+ClassFilter::Term ClassFilter::parseTerm(std::string text)
+{
+  Term term;
+  text = trim(lowercase(text));
+  if (!text.empty() && (text[0] == '-' || text[0] == '!'))
+  {
+    term.negated = true;
+    text = trim(text.substr(1));
+  }
+  if (!text.empty() && text[0] == '=')
+  {
+    term.mode = MatchMode::Exact;
+    text = trim(text.substr(1));
+  }
+  else if (!text.empty() && text.back() == '*')
+  {
+    term.mode = MatchMode::Prefix;
+    text = trim(text.substr(0, text.size() - 1));
+  }
+  term.text = text;
+  return term;
+}
+
+bool ClassFilter::matches(const Term& term, const std::string& name)
+{
+  switch (term.mode)
+  {
+    case MatchMode::Exact:
+      return name == term.text;
+    case MatchMode::Prefix:
+      return name.compare(0, term.text.size(), term.text) == 0;
+    case MatchMode::Substring:
+    default:
+      return name.find(term.text) != std::string::npos;
+  }
+}
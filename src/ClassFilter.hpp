@@ -0,0 +1,103 @@
+#ifndef CLASSFILTER_H
+#define CLASSFILTER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Tells if the class is set in the mask produced by ClassFilter.
+ *
+ * @param mask one bit per class, empty mask accepts all classes
+ * @param classid index of the class
+ * @return true if the class is accepted
+ */
+inline bool maskAccepts(const std::vector<uint64_t>& mask, unsigned int classid)
+{
+  if (mask.empty())
+  {
+    return true;
+  }
+  size_t word = classid / 64;
+  return word < mask.size() && (mask[word] >> (classid % 64) & 1);
+}
+
+/**
+ * Class name filter compiled into a bitset over class indices.
+ *
+ * The filter text is a comma-separated list of case-insensitive terms:
+ * "car" matches names containing the term, "car*" names starting with it and "=car" only the exact name.
+ * Terms preceded with "-" or "!" exclude the classes they match. A class is accepted when it matches
+ * any of the including terms, or there are none, and none of the excluding terms.
+ *
+ * The text is parsed only when it changes, so matching a detection is a single bit test.
+ */
+class ClassFilter
+{
+public:
+  /**
+   * Sets the class names the filter is compiled against and accepts all classes.
+   *
+   * @param names names of the classes, indexed by class id
+   */
+  void setNames(const std::vector<std::string>& names);
+
+  /**
+   * Compiles the filter text if it differs from the last compiled one.
+   *
+   * @param text filter text
+   * @return true if the mask changed
+   */
+  bool compile(const std::string& text);
+
+  /**
+   * Tells if the class passes the filter.
+   *
+   * @param classid index of the class
+   * @return true if the class is accepted
+   */
+  bool accepts(unsigned int classid) const
+  {
+    return classid < classcount && maskAccepts(bits, classid);
+  }
+
+  /**
+   * Returns the compiled mask, one bit per class.
+   *
+   * @return words of the bitset, class i is bit i % 64 of word i / 64
+   */
+  const std::vector<uint64_t>& mask() const;
+
+  /**
+   * Returns the number of compilations that changed the mask, used to detect changes cheaply.
+   *
+   * @return version of the mask
+   */
+  uint64_t version() const;
+
+private:
+  enum class MatchMode
+  {
+    Substring,
+    Prefix,
+    Exact
+  };
+
+  struct Term
+  {
+    std::string text;
+    MatchMode mode = MatchMode::Substring;
+    bool negated = false;
+  };
+
+  static Term parseTerm(std::string term);
+  static bool matches(const Term& term, const std::string& name);
+
+  std::vector<std::string> lowercasenames;
+  std::string source;
+  std::vector<uint64_t> bits;
+  size_t classcount = 0;
+  uint64_t maskversion = 0;
+};
+
+#endif
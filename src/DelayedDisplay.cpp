@@ -0,0 +1,90 @@
+#include "DelayedDisplay.hpp"
+
+DelayedDisplay::DelayedDisplay(size_t capacity) :
+  capacity(capacity)
+{}
+
+void DelayedDisplay::push(CapturedFrame& frame, uint64_t sequence)
+{
+  if (sequence > 0)
+  {
+    lastsubmitted = sequence;
+  }
+  frames.push_back({frame, lastsubmitted});
+  frame.image = cv::Mat();
+  if (!freeimages.empty())
+  {
+    frame.image = freeimages.back();
+    freeimages.pop_back();
+  }
+}
+
+void DelayedDisplay::addDetections(const Detections& detections)
+{
+  if (detections.sequence <= completed)
+  {
+    return;
+  }
+  completed = detections.sequence;
+  results.push_back(detections);
+  // results older than every held frame are never displayed
+  while (results.size() > capacity + 1)
+  {
+    results.pop_front();
+  }
+}
+
+bool DelayedDisplay::release(CapturedFrame& frame, Detections& detections, bool force)
+{
+  if (frames.empty())
+  {
+    return false;
+  }
+  const DelayedFrame& oldest = frames.front();
+  if (oldest.sequence > completed && !force && frames.size() <= capacity)
+  {
+    return false;
+  }
+
+  // the newest detections computed on the frame or before it, frames replaced in the detector's
+  // triple buffer or not passed to it get the previous ones
+  while (results.size() > 1 && results[1].sequence <= oldest.sequence)
+  {
+    results.pop_front();
+  }
+  detections = results.empty() ? Detections() : results.front();
+
+  recycle(frame.image);
+  frame = oldest.frame;
+  frames.pop_front();
+  return true;
+}
+
+void DelayedDisplay::clear()
+{
+  for (DelayedFrame& delayed : frames)
+  {
+    recycle(delayed.frame.image);
+  }
+  frames.clear();
+  results.clear();
+}
+
+bool DelayedDisplay::empty() const
+{
+  return frames.empty();
+}
+
+size_t DelayedDisplay::size() const
+{
+  return frames.size();
+}
+
+void DelayedDisplay::recycle(cv::Mat& image)
+{
+  if (!image.empty() && freeimages.size() < capacity + 2)
+  {
+    freeimages.push_back(image);
+  }
+  image = cv::Mat();
+}
@@ -0,0 +1,95 @@
+#ifndef DELAYEDDISPLAY_H
+#define DELAYEDDISPLAY_H
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "FrameGrabber.hpp"
+#include "ThreadedDetector.hpp"
+
+/**
+ * Holds decoded frames until detections computed on them are available,
+ * so that every frame is displayed with its own detections.
+ *
+ * Frames not passed to the detector are displayed with detections of the last frame passed before them.
+ * When detections lag behind by more than the capacity, the oldest frame is released with the newest
+ * detections available, which bounds the added latency. Image buffers of released frames are reused
+ * for the next pushed frames. Used only by the render thread.
+ */
+class DelayedDisplay
+{
+public:
+  /**
+   * Creates the empty ring
+   * @param capacity - number of frames held before the oldest one is released without its detections
+   */
+  DelayedDisplay(size_t capacity = 8);
+
+  /**
+   * Appends the frame to the ring.
+   *
+   * The image is taken over and replaced with a recycled buffer, or an empty image.
+   *
+   * @param frame decoded frame, receives a buffer for the next frame
+   * @param sequence sequence number returned by the detector, 0 if the frame was not passed to it
+   */
+  void push(CapturedFrame& frame, uint64_t sequence);
+
+  /**
+   * Keeps detections of a new frame until the frame is released.
+   *
+   * @param detections latest results of the detector, ignored if they were already added
+   */
+  void addDetections(const Detections& detections);
+
+  /**
+   * Takes the oldest frame if its detections are available or the ring is over capacity.
+   *
+   * @param frame previously released frame, its buffer is recycled, receives the released frame
+   * @param detections receives detections of the released frame
+   * @param force if true, the oldest frame is released even if its detections are not available
+   * @return true if a frame was released
+   */
+  bool release(CapturedFrame& frame, Detections& detections, bool force = false);
+
+  /**
+   * Drops all held frames and detections.
+   */
+  void clear();
+
+  /**
+   * Tells if no frame is held.
+   *
+   * @return true if the ring is empty
+   */
+  bool empty() const;
+
+  /**
+   * Returns the number of held frames.
+   *
+   * @return ring size
+   */
+  size_t size() const;
+
+  size_t capacity;
+
+private:
+  struct DelayedFrame
+  {
+    CapturedFrame frame;
+    uint64_t sequence = 0;
+  };
+
+  void recycle(cv::Mat& image);
+
+  std::deque<DelayedFrame> frames;
+  std::deque<Detections> results;
+  std::vector<cv::Mat> freeimages;
+  uint64_t lastsubmitted = 0;
+  uint64_t completed = 0;
+};
+
+#endif
@@ -1,69 +1,64 @@
 #include "DetectionVisualizer.hpp"
 
+#include <algorithm>
+#include <cmath>
+
 inline std::runtime_error errorMessage(std::string msg)
 {
   return std::runtime_error(msg + ":\n" + std::strerror(errno));
 }
 
-ThreadedDetector::ThreadedDetector(std::string& cfgfile, std::string& weightsfile) :
-  detector(cfgfile, weightsfile)
-{}
-
-void ThreadedDetector::setFrame(cv::Mat newframe)
-{
-  std::lock_guard<std::mutex> guard(framemutex);
-  frame = newframe.clone();
-}
-
-cv::Mat ThreadedDetector::getFrame()
-{
-  std::lock_guard<std::mutex> guard(framemutex);
-  return frame;
-}
-
-void ThreadedDetector::setDetectedObjects(std::vector<bbox_t> detected)
-{
-  std::lock_guard<std::mutex> guard(detectedobjectsmutex);
-  detectedobjects = detected;
-}
+typedef std::chrono::steady_clock Clock;
 
-std::vector<bbox_t> ThreadedDetector::getDetectedObjects()
+inline double millisecondsSince(Clock::time_point start)
 {
-  std::lock_guard<std::mutex> guard(detectedobjectsmutex);
-  return detectedobjects;
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
 }
 
-bool ThreadedDetector::isRunning()
+/**
+ * Returns flags of the window showing the frames, which covers the viewport and takes no input
+ */
+static ImGuiWindowFlags frameWindowFlags()
 {
-  return running;
+  ImGuiWindowFlags windowflags = 0;
+  windowflags |= ImGuiWindowFlags_NoTitleBar;
+  windowflags |= ImGuiWindowFlags_NoResize;
+  windowflags |= ImGuiWindowFlags_NoMove;
+  windowflags |= ImGuiWindowFlags_NoScrollbar;
+  windowflags |= ImGuiWindowFlags_NoScrollWithMouse;
+  windowflags |= ImGuiWindowFlags_NoCollapse;
+  windowflags |= ImGuiWindowFlags_NoDecoration;
+  windowflags |= ImGuiWindowFlags_NoNav;
+  windowflags |= ImGuiWindowFlags_NoBackground;
+  windowflags |= ImGuiWindowFlags_NoInputs;
+  return windowflags;
 }
 
-void ThreadedDetector::startThread()
+/**
+ * Writes the inference and render rates, measured by the detector and the profiler
+ */
+static void formatFramerate(char* text, size_t size, double inferencetime)
 {
-  running = true;
-  thr = std::thread([this] { this->detectLoop(); });
+  double frametime = Profiler::last(Stage::Frame) / 1000.0;
+  snprintf(text, size,
+      "%.1f / %.1f fps",
+      inferencetime > 0.0 ? 1.0 / inferencetime : 0.0,
+      frametime > 0.0 ? 1.0 / frametime : 0.0);
 }
 
-void ThreadedDetector::detectLoop()
+/**
+ * Prints mean, percentiles and maximum of the stage latency recorded by the profiler
+ */
+static void printLatencyStatistics(Stage stage)
 {
-  double starttimer;
-  while(running)
+  HistogramSnapshot snapshot = Profiler::snapshot(stage);
+  if (snapshot.count == 0)
   {
-    starttimer = glfwGetTime();
-    cv::Mat frame = getFrame();
-    if(!frame.empty())
-    {
-      std::vector<bbox_t> detected = detector.detect(frame);
-      setDetectedObjects(detected);
-    }
-    inferencetime = glfwGetTime() - starttimer;
+    return;
   }
-}
-
-ThreadedDetector::~ThreadedDetector()
-{
-  running = false;
-  thr.join();
+  printf("%-14s mean %8.2f ms  p50 %8.2f ms  p95 %8.2f ms  p99 %8.2f ms  max %8.2f ms\n",
+      stageName(stage), snapshot.mean(), snapshot.percentile(0.5), snapshot.percentile(0.95),
+      snapshot.percentile(0.99), snapshot.maximum());
 }
 
 int DetectionVisualizer::parseArguments(int argc, char* argv[])
@@ -74,10 +69,44 @@ int DetectionVisualizer::parseArguments(int argc, char* argv[])
 
     options.add_options()
     ("h,help", "Prints help")
-    ("v,video-file", "path to the video file, \e[1mrequired*\e[0m", cxxopts::value<std::string>(videofilepath))
-    ("i,camera-id", "number of camera in the system, \e[1mrequired*\e[0m", cxxopts::value<int>(cameraID))
+    ("v,video-file", "path to the video file, repeat to display several streams, \e[1mrequired*\e[0m", cxxopts::value<std::vector<std::string>>(videofilepaths))
+    ("i,camera-id", "number of camera in the system, repeat to display several streams, \e[1mrequired*\e[0m", cxxopts::value<std::vector<int>>(cameraids))
+    ("stream-priority", "with several streams, inference weight of every stream in the order of cameras followed by video files (default: 1 for all)", cxxopts::value<std::vector<int>>(streampriorities))
     ("width", "sets input resolution width", cxxopts::value<int>(userspecifiedresolution.width))
     ("height", "sets input resolution height", cxxopts::value<int>(userspecifiedresolution.height))
+    ("capture-format", "pixel layout of decoded video file frames: bgr, nv12 or i420", cxxopts::value<std::string>(captureformatname))
+    ("drop-policy", "what to do when frames are decoded faster than displayed: drop-oldest or block (default: drop-oldest for cameras, block for video files)", cxxopts::value<std::string>(droppolicyname))
+    ("capture-queue-size", "number of decoded frames buffered by the capture thread", cxxopts::value<int>(capturequeuesize))
+    ("skip-mode", "frames passed to the detector when inference is slower than the source: latest (newest frame when the detector is free) or every-nth (every Nth frame, N adapted to the inference time)", cxxopts::value<std::string>(skipmodename))
+    ("target-latency", "skips frames whose detections would be older than given number of milliseconds when displayed, unless the detector is idle (default: no limit)", cxxopts::value<float>(targetlatency))
+    ("tracker", "assigns track identifiers to detections and predicts their boxes on every displayed frame between inferences", cxxopts::value<bool>(tracking))
+    ("tracker-flow", "with the tracker, refines predicted boxes with optical flow on every displayed frame", cxxopts::value<bool>(trackingflow))
+    ("sync-overlay", "delays displayed frames until their own detections are available, so boxes are drawn on the frame they were detected on", cxxopts::value<bool>(synchronizedoverlay))
+    ("sync-overlay-frames", "with synchronized overlay, maximum number of frames held back, which bounds the added latency", cxxopts::value<int>(synchronizedframes))
+    ("class-filter", "starting class filter: comma-separated terms matching names containing the term, \"term*\" names starting with it, \"=term\" exact names, and \"-term\" or \"!term\" excluding classes", cxxopts::value<std::string>(filterclass))
+    ("filter-in-detector", "drops classes rejected by the class filter in the detector, before non-maximum suppression, instead of only hiding them", cxxopts::value<bool>(filterindetector))
+    ("nms", "non-maximum suppression of detected boxes: class (boxes of the same class), agnostic (boxes of any class) or darknet (darknet's built-in suppression)", cxxopts::value<std::string>(nmsmodename))
+    ("nms-threshold", "starting overlap (IoU) above which a less probable box is suppressed", cxxopts::value<float>(nmssettings.iouthreshold))
+    ("soft-nms", "lowers the probability of overlapping boxes with a Gaussian decay instead of removing them", cxxopts::value<bool>(nmssettings.soft))
+    ("tiles", "splits frames into overlapping tiles detected separately and merged with non-maximum suppression, to find small objects in high resolution frames: auto (tiles of the network input size) or CxR (C columns and R rows)", cxxopts::value<std::string>(tilesname))
+    ("tile-overlap", "fraction of the tile size shared with the neighbouring tile", cxxopts::value<float>(tiling.overlap))
+    ("tiles-only", "with tiles, does not detect the whole frame in addition to the tiles, objects larger than a tile may be missed", cxxopts::value<bool>(tilesonly))
+    ("roi-file", "file with regions of interest, one polygon per line as space-separated x,y vertices in source pixels; the detector runs only on their crops and objects outside them are discarded, regions drawn with \"Edit regions\" are saved to it", cxxopts::value<std::string>(roifile))
+    ("letterbox", "preserves aspect ratio of frames resized to the network input", cxxopts::value<bool>(letterbox))
+    ("profiler", "shows the profiler panel with per-stage latencies at startup", cxxopts::value<bool>(showprofiler))
+    ("trace-file", "records begin and end of pipeline stages from all threads and writes them as Chrome trace JSON on exit", cxxopts::value<std::string>(tracefile))
+    ("pixel-buffers", "number of pixel buffer objects used for texture uploads", cxxopts::value<int>(pixelbuffers))
+    ("disable-persistent-mapping", "maps pixel buffers on every upload instead of keeping them persistently mapped", cxxopts::value<bool>(disablepersistentmapping))
+    ("headless", "runs the pipeline over the video source without a window and prints latency statistics", cxxopts::value<bool>(headless))
+    ("source-rate", "in headless mode, reads frames at the rate of the video file instead of as fast as possible", cxxopts::value<bool>(sourcerate))
+    ("max-frames", "in headless mode, stops after processing given number of frames", cxxopts::value<int>(maxframes))
+    ("batch-size", "in headless mode, number of frames processed by the network at once; with tiles, number of tiles of a frame processed at once", cxxopts::value<int>(batchsize))
+    ("detector-workers", "in headless mode, number of detectors with their own network processing frames in parallel", cxxopts::value<int>(detectorworkers))
+    ("share-weights", "in headless mode with multiple detectors, loads weights once and shares them between detectors (CPU builds of darknet only)", cxxopts::value<bool>(shareweights))
+    ("weights-cache", "maps fused weights from a cache file, created from the weights file on the first run, instead of reading the weights file", cxxopts::value<bool>(weightscache))
+    ("weights-cache-dir", "directory of the weights cache (default: $XDG_CACHE_HOME/darknet-demo or ~/.cache/darknet-demo)", cxxopts::value<std::string>(weightscachedirectory))
+    ("max-in-flight", "in headless mode with multiple detectors, maximum number of frames being processed (default: twice the number of detectors)", cxxopts::value<int>(maxinflight))
+    ("detections-file", "in headless mode, writes detections of every frame in frame order as JSON lines", cxxopts::value<std::string>(detectionsfile))
     ("f,fullscreen", "puts window in fullscreen mode", cxxopts::value<bool>(fullscreen))
     ("n,names-file", "path to the file with names of detected objects, \e[1mrequired\e[0m", cxxopts::value<std::string>(namesfile))
     ("c,cfg-file", "path to the file with configuration, \e[1mrequired\e[0m", cxxopts::value<std::string>(cfgfile))
@@ -89,10 +118,15 @@ int DetectionVisualizer::parseArguments(int argc, char* argv[])
     if (result.count("help")) 
     {
       std::cout << options.help({""}) << std::endl;
-      std::cout << "\e[1m*\e[0m - precisely one of two starred arguments is required" << std::endl;
+      std::cout << "\e[1m*\e[0m - at least one of two starred arguments is required, more than one source displays all of them in a grid" << std::endl;
       std::cout << "During application runtime F key toggles between fullscreen and window mode." << std::endl << std::endl;
       return EXIT_FAILURE;
     }
+    if (!isMultiStream())
+    {
+      cameraID = cameraids.empty() ? -1 : cameraids[0];
+      videofilepath = videofilepaths.empty() ? "" : videofilepaths[0];
+    }
   }
   catch (const cxxopts::OptionException& e)
   {
@@ -115,12 +149,199 @@ void DetectionVisualizer::openNamesFile()
   std::string line;
   while(getline(file, line))
     objectnames.push_back(line);
+
+  classfilter.setNames(objectnames);
+  classfilter.compile(filterclass);
+}
+
+void DetectionVisualizer::selectDropPolicy()
+{
+  if (droppolicyname == "")
+  {
+    droppolicy = cameraID >= 0 ? DropPolicy::DropOldest : DropPolicy::Block;
+  }
+  else if (droppolicyname == "drop-oldest")
+  {
+    droppolicy = DropPolicy::DropOldest;
+  }
+  else if (droppolicyname == "block")
+  {
+    droppolicy = DropPolicy::Block;
+  }
+  else
+  {
+    throw std::runtime_error("Unknown drop policy: " + droppolicyname + "\nUse --help to print usage.");
+  }
+}
+
+void DetectionVisualizer::selectCaptureFormat()
+{
+  if (captureformatname == "bgr")
+  {
+    captureformat = PixelFormat::BGR;
+  }
+  else if (captureformatname == "nv12")
+  {
+    captureformat = PixelFormat::NV12;
+  }
+  else if (captureformatname == "i420")
+  {
+    captureformat = PixelFormat::I420;
+  }
+  else
+  {
+    throw std::runtime_error("Unknown capture format: " + captureformatname + "\nUse --help to print usage.");
+  }
+}
+
+void DetectionVisualizer::selectSkipMode()
+{
+  if (skipmodename == "latest")
+  {
+    skipmode = SkipMode::LatestOnly;
+  }
+  else if (skipmodename == "every-nth")
+  {
+    skipmode = SkipMode::EveryNth;
+  }
+  else
+  {
+    throw std::runtime_error("Unknown skip mode: " + skipmodename + "\nUse --help to print usage.");
+  }
+}
+
+void DetectionVisualizer::openRegionsFile()
+{
+  if (roifile == "")
+  {
+    return;
+  }
+  if (isMultiStream())
+  {
+    throw std::runtime_error("Regions of interest are supported only with a single stream\nUse --help to print usage.");
+  }
+  // a missing file is created when the regions drawn in the window are saved
+  if (std::ifstream(roifile))
+  {
+    regions.load(roifile);
+  }
+}
+
+void DetectionVisualizer::selectTiling()
+{
+  tiling.fullframe = !tilesonly;
+  if (tilesname == "")
+  {
+    return;
+  }
+  if (tilesname == "auto")
+  {
+    tiling.automatic = true;
+  }
+  else
+  {
+    char separator = 0;
+    char trailing = 0;
+    if (sscanf(tilesname.c_str(), "%d%c%d%c", &tiling.columns, &separator, &tiling.rows, &trailing) != 3
+        || separator != 'x' || tiling.columns < 1 || tiling.rows < 1)
+    {
+      throw std::runtime_error("Unknown tiles: " + tilesname + "\nUse --help to print usage.");
+    }
+  }
+  if (tiling.overlap < 0.0f || tiling.overlap >= 0.9f)
+  {
+    throw std::runtime_error("Tile overlap must be at least 0 and below 0.9\nUse --help to print usage.");
+  }
+  if (tiling.enabled() && captureformat != PixelFormat::BGR)
+  {
+    throw std::runtime_error("Tiled inference requires bgr capture format\nUse --help to print usage.");
+  }
+}
+
+void DetectionVisualizer::selectNmsMode()
+{
+  if (nmsmodename == "class")
+  {
+    nmssettings.enabled = true;
+    nmssettings.classaware = true;
+  }
+  else if (nmsmodename == "agnostic")
+  {
+    nmssettings.enabled = true;
+    nmssettings.classaware = false;
+  }
+  else if (nmsmodename == "darknet")
+  {
+    nmssettings.enabled = false;
+  }
+  else
+  {
+    throw std::runtime_error("Unknown NMS mode: " + nmsmodename + "\nUse --help to print usage.");
+  }
+}
+
+void DetectionVisualizer::nmsControls()
+{
+  int nmsmodeindex = !nmssettings.enabled ? 0 : nmssettings.classaware ? 1 : 2;
+  if (ImGui::Combo("Suppression", &nmsmodeindex, "Darknet\0Per class\0All classes\0"))
+  {
+    nmssettings.enabled = nmsmodeindex != 0;
+    nmssettings.classaware = nmsmodeindex == 1;
+  }
+  ImGui::SliderFloat("IoU threshold", &nmssettings.iouthreshold, 0.05f, 0.95f);
+  ImGui::SameLine();
+  ImGui::Checkbox("Soft-NMS", &nmssettings.soft);
+}
+
+void DetectionVisualizer::filterControls()
+{
+  ImGui::InputText("Class name", &filterclass, ImGuiInputTextFlags_CallbackCharFilter,
+    [](ImGuiInputTextCallbackData* d) -> int {
+      ImWchar c = d->EventChar;
+      return !(std::isalpha(c) || c == ' ' || c == ',' || c == '=' || c == '*' || c == '-' || c == '!');
+  });
+  ImGui::SliderFloat("Probability threshold", &threshold, 0.0f, 1.0f);
+  ImGui::Checkbox("Skip filtered classes in detector", &filterindetector);
+  nmsControls();
+}
+
+void DetectionVisualizer::pushDetectorSettings(ThreadedDetector& detector, PushedSettings& pushed)
+{
+  uint64_t maskversion = filterindetector ? classfilter.version() : 0;
+  if (maskversion != pushed.maskversion)
+  {
+    detector.setClassMask(filterindetector ? classfilter.mask() : std::vector<uint64_t>());
+    pushed.maskversion = maskversion;
+  }
+  if (nmssettings != pushed.nms)
+  {
+    detector.setNmsSettings(nmssettings);
+    pushed.nms = nmssettings;
+  }
+}
+
+void DetectionVisualizer::drawStatusText(ImDrawList* drawlist, cv::Size windowposition, const char* text, float& height)
+{
+  ImVec2 textsize = ImGui::CalcTextSize(text);
+  height += textsize.y;
+  drawlist -> AddText(
+      ImVec2 (
+        windowposition.width + mainwindow.viewportsize.width - textsize.x - cornerroundingfactor,
+        windowposition.height + mainwindow.viewportsize.height - height - cornerroundingfactor),
+      frameratecolor,
+      text
+      );
 }
 
-void DetectionVisualizer::cameraInputInit()
+cv::Size DetectionVisualizer::cameraInputInit(cv::VideoCapture& capture, int cameraid)
 {
+  if (captureformat != PixelFormat::BGR)
+  {
+    throw std::runtime_error("Camera frames can only be captured in bgr format\nUse --help to print usage.");
+  }
+
   int apiID = cv::CAP_ANY;
-  capture.open("/dev/video" + std::to_string(cameraID));
+  capture.open("/dev/video" + std::to_string(cameraid));
 
   if(!capture.isOpened()) {
     throw errorMessage("Failed to initiate camera capture");
@@ -159,14 +380,22 @@ void DetectionVisualizer::cameraInputInit()
   originalresolution.width = capture.get(cv::CAP_PROP_FRAME_WIDTH);
   originalresolution.height = capture.get(cv::CAP_PROP_FRAME_HEIGHT);
 
-  mainwindow.updateContentSize(originalresolution);
-
   std::cout << "Got " << originalresolution.width << " x " << originalresolution.height << "." << std::endl << std::endl;
+  return originalresolution;
 }
 
-void DetectionVisualizer::videoInputInit()
+cv::Size DetectionVisualizer::videoInputInit(cv::VideoCapture& capture, const std::string& path)
 {
-  capture.open("filesrc location=" + videofilepath + " ! decodebin ! videoconvert ! appsink" , cv::CAP_GSTREAMER);
+  std::string caps = "";
+  if (captureformat == PixelFormat::NV12)
+  {
+    caps = " ! video/x-raw,format=NV12";
+  }
+  else if (captureformat == PixelFormat::I420)
+  {
+    caps = " ! video/x-raw,format=I420";
+  }
+  capture.open("filesrc location=" + path + " ! decodebin ! videoconvert" + caps + " ! appsink" , cv::CAP_GSTREAMER);
   if(!capture.isOpened()) {
     throw errorMessage("Failed to initiate video file capture");   
   }
@@ -194,106 +423,441 @@ void DetectionVisualizer::videoInputInit()
       userspecifiedresolution.height
     };
   }
-  mainwindow.updateContentSize(designatedresolution);
+  return designatedresolution;
 }
 
-void DetectionVisualizer::detectDisplayLoop()
+std::string DetectionVisualizer::weightsCacheDirectory()
 {
-  ThreadedDetector detector(cfgfile, weightsfile);
-  cv::Mat frame;
+  if (!weightscache)
+  {
+    return "";
+  }
+  return weightscachedirectory != "" ? weightscachedirectory : WeightsCache::defaultDirectory();
+}
 
-  ImGuiWindowFlags windowflags = 0;
-  windowflags |= ImGuiWindowFlags_NoTitleBar;
-  windowflags |= ImGuiWindowFlags_NoResize;
-  windowflags |= ImGuiWindowFlags_NoMove;
-  windowflags |= ImGuiWindowFlags_NoScrollbar;
-  windowflags |= ImGuiWindowFlags_NoScrollWithMouse;
-  windowflags |= ImGuiWindowFlags_NoCollapse;
-  windowflags |= ImGuiWindowFlags_NoDecoration;
-  windowflags |= ImGuiWindowFlags_NoNav;
-  windowflags |= ImGuiWindowFlags_NoBackground;
-  windowflags |= ImGuiWindowFlags_NoInputs;
+void DetectionVisualizer::openVideoSource()
+{
+  if (cameraID >= 0)
+  {
+    if ("" == videofilepath)
+    {
+      std::cout << "openning camera no. " << cameraID << std::endl;
+      sourceresolution = cameraInputInit(capture, cameraID);
+    }
+    else
+    {
+      throw std::runtime_error("Too many parameters\nUse --help to print usage.");
+    }
+  }
+  else
+  {
+    if ("" == videofilepath)
+    {
+      throw std::runtime_error("Correct video source parameters not specified\nUse --help to print usage.");
+    }
+    else
+    {
+      std::cout << "openning videofile: " << videofilepath << std::endl;
+      sourceresolution = videoInputInit(capture, videofilepath);
+    }
+  }
+}
 
-  char frameratetext[20];
-  std::string filterclass;
-  double overallstarttimestamp = glfwGetTime();
-  double detectionstarttimestamp = 0.0;
-  double finishtimestamp = glfwGetTime();
+bool DetectionVisualizer::isMultiStream()
+{
+  return cameraids.size() + videofilepaths.size() > 1;
+}
 
-  ImGuiIO& io = ImGui::GetIO();
-  ImFontConfig mainconfig, filterconfig;
-  mainconfig.SizePixels = fontsize;
-  io.Fonts-> AddFontDefault(&mainconfig);
-  filterconfig.SizePixels = filterfontsize;
-  ImFont* filterfont = io.Fonts->AddFontDefault(&filterconfig);
+void DetectionVisualizer::openVideoStreams()
+{
+  for (int cameraid : cameraids)
+  {
+    streams.emplace_back();
+    VideoStream& stream = streams.back();
+    stream.name = "camera " + std::to_string(cameraid);
+    std::cout << "openning camera no. " << cameraid << std::endl;
+    stream.sourceresolution = cameraInputInit(stream.capture, cameraid);
+    stream.droppolicy = droppolicyname == "" ? DropPolicy::DropOldest : droppolicy;
+  }
+  for (const std::string& path : videofilepaths)
+  {
+    streams.emplace_back();
+    VideoStream& stream = streams.back();
+    stream.name = path.substr(path.find_last_of('/') + 1);
+    std::cout << "openning videofile: " << path << std::endl;
+    stream.sourceresolution = videoInputInit(stream.capture, path);
+    stream.droppolicy = droppolicyname == "" ? DropPolicy::Block : droppolicy;
+  }
+}
 
-  while(glfwWindowShouldClose(mainwindow.window) == 0 && glfwGetKey(mainwindow.window, GLFW_KEY_ESCAPE) != GLFW_PRESS)
+cv::Size DetectionVisualizer::streamGridSize()
+{
+  int columns = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(streams.size()))));
+  int rows = (static_cast<int>(streams.size()) + columns - 1) / columns;
+  cv::Size cellsize{0, 0};
+  for (const VideoStream& stream : streams)
   {
+    cellsize.width = std::max(cellsize.width, stream.sourceresolution.width);
+    cellsize.height = std::max(cellsize.height, stream.sourceresolution.height);
+  }
+  return cv::Size(columns * cellsize.width, rows * cellsize.height);
+}
 
-    overallstarttimestamp = glfwGetTime();
+void DetectionVisualizer::filterDetections(const std::vector<bbox_t>& objects)
+{
+  ScopedTimer timer(Stage::Filter);
+  // the filter text is parsed only when it changes
+  classfilter.compile(filterclass);
+  visibleobjects.resize(objects.size());
+  for (size_t i = 0; i < objects.size(); i++)
+  {
+    visibleobjects[i] = objects[i].prob >= threshold && classfilter.accepts(objects[i].obj_id);
+  }
+}
 
-    sprintf(frameratetext, 
-        "%.1f / %.1f fps",
-        1000.0/detectionstarttimestamp/1000.0, 
-        1000.0/double(overallstarttimestamp - finishtimestamp)/1000.0);
-    finishtimestamp = glfwGetTime();
+void DetectionVisualizer::drawDetections(ImDrawList* drawlist, const std::vector<bbox_t>& objects, ImVec2 origin, float scalex, float scaley)
+{
+  for (size_t i = 0; i < objects.size(); i++)
+  {
+    if (!visibleobjects[i])
+    {
+      continue;
+    }
+    const bbox_t& object = objects[i];
+    ImU32 color = objectcolors[object.obj_id];
+    char text[160];
+    int length = snprintf(text, sizeof(text), "%s (%f%%)", objectnames[object.obj_id].c_str(), 100 * object.prob);
+    if (object.track_id > 0 && length > 0 && static_cast<size_t>(length) < sizeof(text))
+    {
+      snprintf(text + length, sizeof(text) - length, " #%u", object.track_id);
+    }
+    ImVec2 upperleftcorner(
+        object.x * scalex + origin.x,
+        object.y * scaley + origin.y);
+    ImVec2 lowerrightcorner(
+        upperleftcorner.x + object.w * scalex,
+        upperleftcorner.y + object.h * scaley);
+
+    drawlist -> AddRect(
+        upperleftcorner,
+        lowerrightcorner,
+        color,
+        cornerroundingfactor,
+        0,
+        perimeterthickness);
+
+    ImVec2 textposition(
+        upperleftcorner.x + cornerroundingfactor,
+        upperleftcorner.y - fontsize - cornerroundingfactor);
+    drawlist -> AddText(
+        textposition,
+        color,
+        text
+        );
+  }
+}
 
-    capture.read(frame);
-    if(frame.empty())
+void DetectionVisualizer::drawRegions(ImDrawList* drawlist, ImVec2 origin, float scalex, float scaley)
+{
+  auto toScreen = [&](const cv::Point2f& point) {
+    return ImVec2(point.x * scalex + origin.x, point.y * scaley + origin.y);
+  };
+  for (const std::vector<cv::Point2f>& polygon : regions.polygons())
+  {
+    regionpoints.clear();
+    for (const cv::Point2f& vertex : polygon)
     {
-      perror("Failed to read next frame from video capture object");
-      break;
+      regionpoints.push_back(toScreen(vertex));
     }
+    drawlist -> AddPolyline(regionpoints.data(), static_cast<int>(regionpoints.size()), regioncolor, ImDrawFlags_Closed, perimeterthickness);
+  }
+  if (!editingregions)
+  {
+    return;
+  }
+  regionpoints.clear();
+  for (const cv::Point2f& vertex : regiondraft)
+  {
+    regionpoints.push_back(toScreen(vertex));
+    drawlist -> AddCircleFilled(regionpoints.back(), perimeterthickness * 2, regioncolor);
+  }
+  if (!regionpoints.empty())
+  {
+    regionpoints.push_back(ImGui::GetIO().MousePos);
+    drawlist -> AddPolyline(regionpoints.data(), static_cast<int>(regionpoints.size()), regioncolor, 0, perimeterthickness);
+  }
+}
 
-    cv::resize(frame, frame, cv::Size(mainwindow.viewportsize.width, mainwindow.viewportsize.height), cv::INTER_LINEAR);
-    cvtColor(frame, frame, cv::COLOR_BGR2RGBA);
+void DetectionVisualizer::editRegions(ImVec2 origin, float scalex, float scaley, cv::Size framesize)
+{
+  // clicks on the filter and profiler windows are not vertices
+  if (!editingregions || ImGui::GetIO().WantCaptureMouse || framesize.area() == 0)
+  {
+    return;
+  }
+  if (ImGui::IsMouseClicked(ImGuiMouseButton_Left))
+  {
+    ImVec2 mouse = ImGui::GetMousePos();
+    regiondraft.emplace_back(
+        std::clamp((mouse.x - origin.x) / scalex, 0.0f, static_cast<float>(framesize.width)),
+        std::clamp((mouse.y - origin.y) / scaley, 0.0f, static_cast<float>(framesize.height)));
+  }
+  if (ImGui::IsMouseClicked(ImGuiMouseButton_Right))
+  {
+    regions.add(regiondraft);
+    regiondraft.clear();
+  }
+}
 
-    detector.setFrame(frame);
-    if(!detector.isRunning())
+void DetectionVisualizer::regionControls(cv::Size framesize)
+{
+  ImGui::Checkbox("Edit regions", &editingregions);
+  ImGui::SameLine();
+  if (ImGui::Button("Clear regions"))
+  {
+    regions.clear();
+    regiondraft.clear();
+  }
+  if (roifile != "")
+  {
+    ImGui::SameLine();
+    if (ImGui::Button("Save regions"))
     {
-      detector.startThread();
+      try
+      {
+        regions.save(roifile);
+      }
+      catch (std::runtime_error& err)
+      {
+        std::cerr << err.what() << std::endl;
+      }
     }
-    std::vector<bbox_t> detected_objects = detector.getDetectedObjects();
+  }
+  if (editingregions)
+  {
+    ImGui::Text("Left click adds a vertex, right click closes the region");
+  }
+  if (croptimings.empty() || framesize.area() == 0)
+  {
+    return;
+  }
+  double croppedpixels = 0.0;
+  double inferencetime = 0.0;
+  for (const CropTiming& timing : croptimings)
+  {
+    croppedpixels += timing.crop.area();
+    inferencetime += timing.inferencetime;
+  }
+  if (!regions.empty())
+  {
+    ImGui::Text("%zu crops, %.0f%% pixels saved, %.2f ms",
+        croptimings.size(), 100.0 * (1.0 - croppedpixels / framesize.area()), 1000.0 * inferencetime);
+  }
+  else
+  {
+    ImGui::Text("%zu tiles, %.2f ms, %.0f tiles/s",
+        croptimings.size(), 1000.0 * inferencetime, inferencetime > 0.0 ? croptimings.size() / inferencetime : 0.0);
+  }
+  // tiled 4K frames have dozens of crops, so they are listed only on demand
+  if (!ImGui::CollapsingHeader("Crops"))
+  {
+    return;
+  }
+  for (size_t i = 0; i < croptimings.size(); i++)
+  {
+    const CropTiming& timing = croptimings[i];
+    ImGui::Text("Crop %zu: %d x %d at (%d, %d), %.2f ms", i + 1,
+        timing.crop.width, timing.crop.height, timing.crop.x, timing.crop.y, 1000.0 * timing.inferencetime);
+  }
+}
 
-    detectionstarttimestamp = detector.inferencetime;
+void DetectionVisualizer::detectDisplayLoop(ThreadedDetector& detector)
+{
+  FrameGrabber grabber(capture, capturequeuesize, droppolicy);
+  TextureStreamer texturestreamer(mainwindow.getGlslVersion(), pixelbuffers, !disablepersistentmapping);
+  CapturedFrame captured;
+  cv::Size sourcesize;
+  ProfilerPanel profilerpanel;
+  CapturedFrame displayed;
+  FrameSkipScheduler scheduler(skipmode, targetlatency / 1000.0);
+  ObjectTracker tracker;
+  uint64_t trackedsequence = 0;
+  // kept between frames, so that the steady state reuses their storage instead of allocating
+  Detections detections;
+  std::vector<bbox_t> trackedobjects;
+  uint64_t frameallocations = threadAllocations();
+  PushedSettings pushedsettings;
+  uint64_t pushedregionsversion = 0;
+  DelayedDisplay delayeddisplay(static_cast<size_t>(std::max(synchronizedframes, 1)));
+
+  const ImGuiWindowFlags windowflags = frameWindowFlags();
+
+  char frameratetext[64];
+  char queuetext[80];
+  char stalenesstext[128];
+  bool firstframe = true;
+  bool firstdetection = true;
+
+  grabber.start();
 
-    glfwPollEvents();
-    glClearColor(0.0f, 0.0f, 0.4f, 0.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
+  while(glfwWindowShouldClose(mainwindow.window) == 0 && glfwGetKey(mainwindow.window, GLFW_KEY_ESCAPE) != GLFW_PRESS)
+  {
+    ScopedTimer frametimer(Stage::Frame);
 
-    ImGui_ImplOpenGL3_NewFrame();
-    ImGui_ImplGlfw_NewFrame();
-    ImGui::NewFrame();
+    uint64_t allocations = threadAllocations();
+    profilerpanel.setFrameAllocations(allocations - frameallocations);
+    frameallocations = allocations;
 
-    cv::Size imguiwindowposition {
-      mainwindow.size.width/2 - mainwindow.viewportsize.width/2,
-      mainwindow.size.height/2 - mainwindow.viewportsize.height/2};
+    formatFramerate(frameratetext, sizeof(frameratetext), detector.inferencetime);
 
-    ImGui::SetNextWindowPos(ImVec2(imguiwindowposition.width, imguiwindowposition.height));
-    ImGui::SetNextWindowSize(ImVec2(mainwindow.viewportsize.width, mainwindow.viewportsize.height));
-    if (!ImGui::Begin("stream window", NULL, windowflags))
+    bool newframe;
     {
-      perror("Failed to initiate ImGui");
-      ImGui::End();
-      return;
+      ScopedTimer timer(Stage::CaptureWait);
+      newframe = grabber.pop(captured, maxframewait);
+    }
+    bool sourcefinished = !newframe && grabber.finished();
+    if(sourcefinished && delayeddisplay.empty())
+    {
+      perror("Failed to read next frame from video capture object");
+      break;
     }
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, frame.cols, frame.rows, 0, GL_RGBA, GL_UNSIGNED_BYTE, frame.data);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-
-    ImGui::Image(reinterpret_cast<void*>(static_cast<intptr_t>(textureID)), ImVec2(frame.cols, frame.rows));
-    ImDrawList* drawlist = ImGui::GetWindowDrawList();
-    
-    ImGui::End();
-    ImGui::PushFont(filterfont);
-    ImGui::Begin("Filter");
+    if(newframe)
+    {
+      if(firstframe)
+      {
+        logStartupEvent("first frame");
+        firstframe = false;
+      }
+      uint64_t sequence = 0;
+      scheduler.targetlatency = targetlatency / 1000.0;
+      if(scheduler.shouldSubmit(captured.index, captured.capturetime))
+      {
+        sequence = detector.setFrame(captured.image);
+        scheduler.submitted(sequence, captured.index, captured.capturetime);
+      }
+      if(synchronizedoverlay)
+      {
+        delayeddisplay.push(captured, sequence);
+      }
+
+      if(!detector.isRunning())
+      {
+        detector.startThread();
+      }
+    }
+    detector.getDetectedObjects(detections);
+    if(firstdetection && detections.sequence > 0)
+    {
+      logStartupEvent("first detection");
+      firstdetection = false;
+    }
+    auto now = FrameSkipScheduler::Clock::now();
+    scheduler.update(detections.sequence, detector.inferencetime, now);
+
+    // in the synchronized mode the displayed frame comes from the delay ring along with its own detections
+    bool framedisplayed = newframe;
+    if(synchronizedoverlay)
+    {
+      delayeddisplay.capacity = static_cast<size_t>(std::max(synchronizedframes, 1));
+      delayeddisplay.addDetections(detections);
+      framedisplayed = delayeddisplay.release(displayed, detections, sourcefinished);
+    }
+    else
+    {
+      delayeddisplay.clear();
+      if(newframe)
+      {
+        std::swap(displayed, captured);
+      }
+    }
+    if(framedisplayed)
+    {
+      sourcesize = pictureSize(displayed.image, captureformat);
+      if(tracking && trackingflow)
+      {
+        tracker.refine(displayed.image, captureformat, displayed.capturetime);
+      }
+    }
+    Staleness staleness = scheduler.staleness(detections.sequence, displayed.index, now);
+    double displaydelay = displayed.image.empty() ? 0.0 : std::chrono::duration<double, std::milli>(now - displayed.capturetime).count();
+
+    std::vector<bbox_t>* shownobjects = &detections.objects;
+    if(tracking)
+    {
+      if(detections.sequence != trackedsequence)
+      {
+        FrameSkipScheduler::Clock::time_point capturetime = now;
+        scheduler.arrivalTime(detections.sequence, capturetime);
+        tracker.update(detections.objects, capturetime);
+        trackedsequence = detections.sequence;
+      }
+      tracker.predict(displayed.capturetime, trackedobjects);
+      shownobjects = &trackedobjects;
+    }
+    else if(tracker.trackCount() > 0)
+    {
+      tracker.clear();
+      trackedsequence = 0;
+    }
+    const std::vector<bbox_t>& detected_objects = *shownobjects;
+
+    glfwPollEvents();
+    glClearColor(0.0f, 0.0f, 0.4f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    auto drawliststart = Profiler::Clock::now();
+    ImGui_ImplOpenGL3_NewFrame();
+    ImGui_ImplGlfw_NewFrame();
+    ImGui::NewFrame();
+
+    cv::Size imguiwindowposition {
+      mainwindow.size.width/2 - mainwindow.viewportsize.width/2,
+      mainwindow.size.height/2 - mainwindow.viewportsize.height/2};
+
+    ImGui::SetNextWindowPos(ImVec2(imguiwindowposition.width, imguiwindowposition.height));
+    ImGui::SetNextWindowSize(ImVec2(mainwindow.viewportsize.width, mainwindow.viewportsize.height));
+    if (!ImGui::Begin("stream window", NULL, windowflags))
+    {
+      perror("Failed to initiate ImGui");
+      ImGui::End();
+      return;
+    }
 
-    ImGui::InputText("Class name", &filterclass, ImGuiInputTextFlags_CallbackCharFilter,
-      [](ImGuiInputTextCallbackData* d) -> int {
-        ImWchar c = d->EventChar;
-        return !(std::isalpha(c) || c == ' ');
-    });
-    ImGui::SliderFloat("Probability threshold", &threshold, 0.0f, 1.0f);
+    if(framedisplayed)
+    {
+      ScopedTimer timer(Stage::TextureUpload);
+      texturestreamer.upload(displayed.image, captureformat);
+    }
+
+    ImDrawList* drawlist = ImGui::GetWindowDrawList();
+    texturestreamer.draw(
+        drawlist,
+        ImVec2(imguiwindowposition.width, imguiwindowposition.height),
+        ImVec2(imguiwindowposition.width + mainwindow.viewportsize.width, imguiwindowposition.height + mainwindow.viewportsize.height));
+    float displayscalex = sourcesize.width > 0 ? static_cast<float>(mainwindow.viewportsize.width) / sourcesize.width : 1.0f;
+    float displayscaley = sourcesize.height > 0 ? static_cast<float>(mainwindow.viewportsize.height) / sourcesize.height : 1.0f;
+    
+    ImGui::End();
+    ImGui::PushFont(filterfont);
+    ImGui::Begin("Filter");
+
+    filterControls();
+    int skipmodeindex = static_cast<int>(scheduler.mode);
+    if (ImGui::Combo("Frame skipping", &skipmodeindex, "Latest only\0Every Nth\0"))
+    {
+      scheduler.mode = static_cast<SkipMode>(skipmodeindex);
+    }
+    ImGui::SliderFloat("Target latency (ms, 0 = off)", &targetlatency, 0.0f, 1000.0f, "%.0f");
+    ImGui::Checkbox("Synchronize overlay", &synchronizedoverlay);
+    ImGui::SameLine();
+    ImGui::SliderInt("Held frames", &synchronizedframes, 1, 30);
+    ImGui::Checkbox("Track objects", &tracking);
+    ImGui::SameLine();
+    ImGui::Checkbox("Optical flow", &trackingflow);
+    detector.getCropTimings(croptimings);
+    regionControls(sourcesize);
+    ImGui::Checkbox("Show profiler", &showprofiler);
 
     ImGui::BeginChild("scrolling");
     ImGui::BeginTable("Detections", 2);
@@ -303,73 +867,67 @@ void DetectionVisualizer::detectDisplayLoop()
 
     ImGui::PopFont();
 
-    for (bbox_t object : detected_objects) {
-      ImU32 color = objectcolors[object.obj_id];
-      std::string objectclass = objectnames[object.obj_id];
-      ImVec4 listitemcolor;
-      std::string text = objectnames[object.obj_id] + " (" + std::to_string(100 * object.prob) + "%)";
-      
-      std::transform(objectclass.begin(), objectclass.end(), objectclass.begin(),
-              [](unsigned char c){ return std::tolower(c); }
-      );
-      std::transform(filterclass.begin(), filterclass.end(), filterclass.begin(),
-              [](unsigned char c){ return std::tolower(c); }
-      );
+    filterDetections(detected_objects);
+    ImVec2 frameorigin(imguiwindowposition.width, imguiwindowposition.height);
+    drawDetections(drawlist, detected_objects, frameorigin, displayscalex, displayscaley);
+    editRegions(frameorigin, displayscalex, displayscaley, sourcesize);
+    drawRegions(drawlist, frameorigin, displayscalex, displayscaley);
+    if (regions.version() != pushedregionsversion)
+    {
+      detector.setRegions(regions);
+      pushedregionsversion = regions.version();
+    }
+    pushDetectorSettings(detector, pushedsettings);
 
-      if(object.prob >= threshold && 
-              objectclass.find(filterclass) != std::string::npos) {
-        ImVec2 upperleftcorner(
-            object.x + imguiwindowposition.width,
-            object.y + imguiwindowposition.height);
-        ImVec2 lowerrightcorner(
-            upperleftcorner.x + object.w,
-            upperleftcorner.y + object.h);
-  
-        drawlist -> AddRect(
-            upperleftcorner,
-            lowerrightcorner,
-            color,
-            cornerroundingfactor,
-            0,
-            perimeterthickness); 
-  
-        ImVec2 textposition(
-            upperleftcorner.x + cornerroundingfactor,
-            upperleftcorner.y - fontsize - cornerroundingfactor);
-        drawlist -> AddText(
-            textposition,
-            color,
-            text.c_str()
-            );
-
-        listitemcolor = ImGui::ColorConvertU32ToFloat4(color);
-      }
-      else
-      {
-        listitemcolor = hiddenobjectcolor;
-      }
+    for (size_t i = 0; i < detected_objects.size(); i++) {
+      const bbox_t& object = detected_objects[i];
+      ImVec4 listitemcolor = visibleobjects[i] ? ImGui::ColorConvertU32ToFloat4(objectcolors[object.obj_id]) : hiddenobjectcolor;
 
       ImGui::PushFont(filterfont);
       ImGui::TableNextColumn();
-      ImGui::TextColored(listitemcolor, "%s", objectclass.c_str());
+      ImGui::TextColored(listitemcolor, "%s", objectnames[object.obj_id].c_str());
       ImGui::TableNextColumn();
       ImGui::TextColored(listitemcolor, "%f", object.prob*100);
       ImGui::PopFont();
 
     }
 
-    drawlist -> AddText(
-        ImVec2 (
-          imguiwindowposition.width + mainwindow.viewportsize.width - ImGui::CalcTextSize(frameratetext).x - cornerroundingfactor,
-          imguiwindowposition.height + mainwindow.viewportsize.height - ImGui::CalcTextSize(frameratetext).y - cornerroundingfactor),
-        frameratecolor,
-        frameratetext
-        );
+    float statusheight = 0.0f;
+    drawStatusText(drawlist, imguiwindowposition, frameratetext, statusheight);
+
+    snprintf(queuetext, sizeof(queuetext),
+        "capture queue %zu/%zu (dropped %llu), detector queue %zu/1",
+        grabber.queueDepth(),
+        grabber.queueCapacity(),
+        static_cast<unsigned long long>(grabber.droppedFrames()),
+        detector.queueDepth());
+    drawStatusText(drawlist, imguiwindowposition, queuetext, statusheight);
+
+    snprintf(stalenesstext, sizeof(stalenesstext),
+        "display delay %.0f ms, detections %llu frames / %.0f ms old, every %d frames (skipped %llu)",
+        displaydelay,
+        static_cast<unsigned long long>(staleness.frames),
+        staleness.milliseconds,
+        scheduler.mode == SkipMode::EveryNth ? scheduler.skipInterval() : 1,
+        static_cast<unsigned long long>(scheduler.skippedFrames()));
+    drawStatusText(drawlist, imguiwindowposition, stalenesstext, statusheight);
 
     ImGui::EndTable();
     ImGui::EndChild();    
     ImGui::End();
+
+    profilerpanel.update();
+    if (showprofiler)
+    {
+      ImGui::PushFont(filterfont);
+      profilerpanel.draw(&showprofiler);
+      ImGui::PopFont();
+    }
+
     ImGui::Render();
+    Profiler::record(Stage::DrawList, drawliststart, Profiler::Clock::now());
+
+    ScopedTimer swaptimer(Stage::Swap);
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
     glfwSwapBuffers(mainwindow.window);
@@ -377,7 +935,508 @@ void DetectionVisualizer::detectDisplayLoop()
   return;
 }
 
-void DetectionVisualizer::errorDisplayLoop(std::string errorstring)
+void DetectionVisualizer::multiStreamDisplayLoop(ThreadedDetector& detector)
+{
+  ProfilerPanel profilerpanel;
+  for (VideoStream& stream : streams)
+  {
+    stream.grabber = std::make_unique<FrameGrabber>(stream.capture, capturequeuesize, stream.droppolicy);
+    stream.texturestreamer = std::make_unique<TextureStreamer>(mainwindow.getGlslVersion(), pixelbuffers, !disablepersistentmapping);
+  }
+
+  const ImGuiWindowFlags windowflags = frameWindowFlags();
+
+  const int columns = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(streams.size()))));
+  const int rows = (static_cast<int>(streams.size()) + columns - 1) / columns;
+  char frameratetext[64];
+  char queuetext[80];
+  bool firstframe = true;
+  bool firstdetection = true;
+  PushedSettings pushedsettings;
+
+  for (VideoStream& stream : streams)
+  {
+    stream.grabber->start();
+  }
+
+  while(glfwWindowShouldClose(mainwindow.window) == 0 && glfwGetKey(mainwindow.window, GLFW_KEY_ESCAPE) != GLFW_PRESS)
+  {
+    ScopedTimer frametimer(Stage::Frame);
+
+    formatFramerate(frameratetext, sizeof(frameratetext), detector.inferencetime);
+
+    // every stream gets a share of the frame wait, streams that already have a frame do not wait at all
+    std::vector<bool> newframes(streams.size(), false);
+    size_t finishedstreams = 0;
+    for (size_t i = 0; i < streams.size(); i++)
+    {
+      VideoStream& stream = streams[i];
+      if (stream.finished)
+      {
+        finishedstreams++;
+        continue;
+      }
+      {
+        ScopedTimer timer(Stage::CaptureWait);
+        newframes[i] = stream.grabber->pop(stream.captured, maxframewait / streams.size());
+      }
+      if (!newframes[i] && stream.grabber->finished())
+      {
+        std::cout << "Stream " << stream.name << " finished" << std::endl;
+        stream.finished = true;
+        continue;
+      }
+      if (newframes[i])
+      {
+        if (firstframe)
+        {
+          logStartupEvent("first frame");
+          firstframe = false;
+        }
+        detector.setFrame(stream.captured.image, i);
+        stream.sourcesize = pictureSize(stream.captured.image, captureformat);
+      }
+    }
+    if (finishedstreams == streams.size())
+    {
+      perror("Failed to read next frame from all video capture objects");
+      break;
+    }
+    if (!firstframe && !detector.isRunning())
+    {
+      detector.startThread();
+    }
+
+    glfwPollEvents();
+    glClearColor(0.0f, 0.0f, 0.4f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    auto drawliststart = Profiler::Clock::now();
+    ImGui_ImplOpenGL3_NewFrame();
+    ImGui_ImplGlfw_NewFrame();
+    ImGui::NewFrame();
+
+    cv::Size imguiwindowposition {
+      mainwindow.size.width/2 - mainwindow.viewportsize.width/2,
+      mainwindow.size.height/2 - mainwindow.viewportsize.height/2};
+
+    ImGui::SetNextWindowPos(ImVec2(imguiwindowposition.width, imguiwindowposition.height));
+    ImGui::SetNextWindowSize(ImVec2(mainwindow.viewportsize.width, mainwindow.viewportsize.height));
+    if (!ImGui::Begin("stream window", NULL, windowflags))
+    {
+      perror("Failed to initiate ImGui");
+      ImGui::End();
+      return;
+    }
+
+    ImDrawList* drawlist = ImGui::GetWindowDrawList();
+    const float cellwidth = static_cast<float>(mainwindow.viewportsize.width) / columns;
+    const float cellheight = static_cast<float>(mainwindow.viewportsize.height) / rows;
+    std::vector<Detections> detections(streams.size());
+    std::vector<std::vector<bool>> visibility(streams.size());
+
+    for (size_t i = 0; i < streams.size(); i++)
+    {
+      VideoStream& stream = streams[i];
+      if (newframes[i])
+      {
+        ScopedTimer timer(Stage::TextureUpload);
+        stream.texturestreamer->upload(stream.captured.image, captureformat);
+      }
+      if (stream.sourcesize.area() == 0)
+      {
+        continue;
+      }
+
+      // frames keep their aspect ratio and are centered in their cell
+      float scale = std::min(cellwidth / stream.sourcesize.width, cellheight / stream.sourcesize.height);
+      ImVec2 framesize(stream.sourcesize.width * scale, stream.sourcesize.height * scale);
+      ImVec2 origin(
+          imguiwindowposition.width + (i % columns) * cellwidth + (cellwidth - framesize.x) / 2,
+          imguiwindowposition.height + (i / columns) * cellheight + (cellheight - framesize.y) / 2);
+      stream.texturestreamer->draw(drawlist, origin, ImVec2(origin.x + framesize.x, origin.y + framesize.y));
+
+      detections[i] = detector.getDetectedObjects(i);
+      if (firstdetection && detections[i].sequence > 0)
+      {
+        logStartupEvent("first detection");
+        firstdetection = false;
+      }
+      filterDetections(detections[i].objects);
+      drawDetections(drawlist, detections[i].objects, origin, scale, scale);
+      visibility[i] = visibleobjects;
+
+      ImVec2 namesize = ImGui::CalcTextSize(stream.name.c_str());
+      drawlist -> AddText(
+          ImVec2(origin.x + cornerroundingfactor, origin.y + framesize.y - namesize.y - cornerroundingfactor),
+          frameratecolor,
+          stream.name.c_str()
+          );
+    }
+    pushDetectorSettings(detector, pushedsettings);
+
+    float statusheight = 0.0f;
+    drawStatusText(drawlist, imguiwindowposition, frameratetext, statusheight);
+
+    snprintf(queuetext, sizeof(queuetext),
+        "%zu streams, detector queue %zu/%d",
+        streams.size(),
+        detector.queueDepth(),
+        detector.streamCount());
+    drawStatusText(drawlist, imguiwindowposition, queuetext, statusheight);
+
+    ImGui::End();
+    ImGui::PushFont(filterfont);
+    ImGui::Begin("Filter");
+
+    filterControls();
+    ImGui::Checkbox("Show profiler", &showprofiler);
+
+    ImGui::BeginChild("scrolling");
+    ImGui::BeginTable("Detections", 3);
+    ImGui::TableSetupColumn("Stream");
+    ImGui::TableSetupColumn("Class", ImGuiTableColumnFlags_WidthStretch);
+    ImGui::TableSetupColumn("Certainty");
+    ImGui::TableHeadersRow();
+
+    for (size_t i = 0; i < streams.size(); i++)
+    {
+      const std::vector<bbox_t>& objects = detections[i].objects;
+      for (size_t j = 0; j < objects.size(); j++)
+      {
+        const bbox_t& object = objects[j];
+        ImVec4 listitemcolor = visibility[i][j] ? ImGui::ColorConvertU32ToFloat4(objectcolors[object.obj_id]) : hiddenobjectcolor;
+        ImGui::TableNextColumn();
+        ImGui::TextColored(listitemcolor, "%s", streams[i].name.c_str());
+        ImGui::TableNextColumn();
+        ImGui::TextColored(listitemcolor, "%s", objectnames[object.obj_id].c_str());
+        ImGui::TableNextColumn();
+        ImGui::TextColored(listitemcolor, "%f", object.prob*100);
+      }
+    }
+
+    ImGui::EndTable();
+    ImGui::EndChild();
+    ImGui::End();
+    ImGui::PopFont();
+
+    profilerpanel.update();
+    if (showprofiler)
+    {
+      ImGui::PushFont(filterfont);
+      profilerpanel.draw(&showprofiler);
+      ImGui::PopFont();
+    }
+
+    ImGui::Render();
+    Profiler::record(Stage::DrawList, drawliststart, Profiler::Clock::now());
+
+    ScopedTimer swaptimer(Stage::Swap);
+    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+
+    glfwSwapBuffers(mainwindow.window);
+  }
+
+  // grabbers and textures are released while the GL context is still current
+  for (VideoStream& stream : streams)
+  {
+    stream.grabber.reset();
+    stream.texturestreamer.reset();
+  }
+}
+
+void DetectionVisualizer::writeDetections(std::ostream& stream, uint64_t frameindex, const std::vector<bbox_t>& objects)
+{
+  stream << "{\"frame\": " << frameindex << ", \"objects\": [";
+  bool first = true;
+  for (const bbox_t& object : objects)
+  {
+    if (object.prob < threshold || !classfilter.accepts(object.obj_id))
+    {
+      continue;
+    }
+    std::string name = objectnames[object.obj_id];
+    name.erase(std::remove_if(name.begin(), name.end(), [](char c) { return c == '"' || c == '\\'; }), name.end());
+    stream << (first ? "" : ", ")
+      << "{\"class\": " << object.obj_id
+      << ", \"name\": \"" << name << "\""
+      << ", \"prob\": " << object.prob
+      << ", \"x\": " << object.x
+      << ", \"y\": " << object.y
+      << ", \"w\": " << object.w
+      << ", \"h\": " << object.h << "}";
+    first = false;
+  }
+  stream << "]}\n";
+}
+
+uint64_t DetectionVisualizer::consumeDetections(std::ofstream& stream, uint64_t frameindex, const std::vector<bbox_t>& objects)
+{
+  ScopedTimer timer(Stage::Filter);
+  uint64_t count = 0;
+  for (const bbox_t& object : objects)
+  {
+    if (object.prob >= threshold && classfilter.accepts(object.obj_id))
+    {
+      count++;
+    }
+  }
+  if (stream.is_open())
+  {
+    writeDetections(stream, frameindex, objects);
+  }
+  return count;
+}
+
+void DetectionVisualizer::headlessLoop()
+{
+  ThreadedDetector detector(cfgfile, weightsfile, letterbox, captureformat, batchsize, weightsCacheDirectory());
+  logStartupEvent("network loaded");
+  detector.setNmsSettings(nmssettings);
+  detector.setRegions(regions);
+  detector.setTiling(tiling);
+  if (filterindetector)
+  {
+    detector.setClassMask(classfilter.mask());
+  }
+  FrameGrabber grabber(capture, capturequeuesize, droppolicy);
+  CapturedFrame captured;
+  if (sourcerate)
+  {
+    grabber.setPacing(capture.get(cv::CAP_PROP_FPS));
+  }
+
+  std::ofstream detectionsstream;
+  if (detectionsfile != "")
+  {
+    detectionsstream.open(detectionsfile);
+    if (!detectionsstream)
+    {
+      throw errorMessage("Failed to open detections file " + detectionsfile);
+    }
+  }
+
+  std::vector<InputTransform> transforms;
+  std::vector<uint64_t> frameindices;
+  std::vector<std::vector<bbox_t>> detected;
+  std::vector<CropTiming> timings;
+  uint64_t frames = 0;
+  uint64_t objects = 0;
+  uint64_t crops = 0;
+  bool finished = false;
+  // cropped frames are detected one by one, the batch holds their crops
+  const bool cropping = tiling.enabled() || !regions.empty();
+  const int framesperbatch = cropping ? 1 : batchsize;
+
+  grabber.start();
+  auto benchmarkstart = Clock::now();
+  while (!finished && (maxframes <= 0 || frames < static_cast<uint64_t>(maxframes)))
+  {
+    ScopedTimer frametimer(Stage::Frame);
+    transforms.clear();
+    frameindices.clear();
+    while (static_cast<int>(frameindices.size()) < framesperbatch
+        && (maxframes <= 0 || frames + frameindices.size() < static_cast<uint64_t>(maxframes)))
+    {
+      bool newframe;
+      {
+        ScopedTimer timer(Stage::CaptureWait);
+        newframe = grabber.pop(captured, maxframewait);
+        while (!newframe && !grabber.finished())
+        {
+          newframe = grabber.pop(captured, maxframewait);
+        }
+      }
+      if (!newframe)
+      {
+        finished = true;
+        break;
+      }
+      if (cropping)
+      {
+        detected.assign(1, detector.detect(captured.image));
+        detector.getCropTimings(timings);
+        crops += timings.size();
+      }
+      else
+      {
+        transforms.push_back(detector.preprocess(captured.image, transforms.size()));
+      }
+      frameindices.push_back(captured.index);
+    }
+    if (frameindices.empty())
+    {
+      break;
+    }
+
+    if (!cropping && batchsize > 1)
+    {
+      detected = detector.inferBatch(transforms);
+    }
+    else if (!cropping)
+    {
+      detected.assign(1, detector.infer(transforms.front()));
+    }
+
+    for (size_t i = 0; i < detected.size(); i++)
+    {
+      objects += consumeDetections(detectionsstream, frameindices[i], detected[i]);
+    }
+    frames += frameindices.size();
+  }
+  double elapsed = millisecondsSince(benchmarkstart) / 1000.0;
+  grabber.stop();
+
+  printHeadlessSummary(frames, elapsed, objects, grabber.droppedFrames());
+  if (frames > 0)
+  {
+    printf("Inference with batch size %d: %.2f ms per frame\n", batchsize, Profiler::snapshot(Stage::Inference).sum / 1000.0 / frames);
+  }
+  if (crops > 0)
+  {
+    printTileStatistics(frames, elapsed, static_cast<double>(crops) / frames);
+  }
+  if (batchsize > 1 && !cropping)
+  {
+    std::cout << "Frame statistics below are per batch" << std::endl;
+  }
+  printStageStatistics();
+}
+
+void DetectionVisualizer::headlessPoolLoop()
+{
+  DetectorPool pool(cfgfile, weightsfile, detectorworkers, maxinflight > 0 ? maxinflight : 2 * detectorworkers, letterbox, captureformat, shareweights, weightsCacheDirectory());
+  logStartupEvent("network loaded");
+  pool.setNmsSettings(nmssettings);
+  pool.setTiling(tiling);
+  if (filterindetector)
+  {
+    pool.setClassMask(classfilter.mask());
+  }
+  FrameGrabber grabber(capture, capturequeuesize, droppolicy);
+  CapturedFrame captured;
+  if (sourcerate)
+  {
+    grabber.setPacing(capture.get(cv::CAP_PROP_FPS));
+  }
+
+  std::ofstream detectionsstream;
+  if (detectionsfile != "")
+  {
+    detectionsstream.open(detectionsfile);
+    if (!detectionsstream)
+    {
+      throw errorMessage("Failed to open detections file " + detectionsfile);
+    }
+  }
+
+  // capture indices of frames in flight, in submission order
+  std::deque<uint64_t> frameindices;
+  Detections detections;
+  uint64_t submitted = 0;
+  uint64_t frames = 0;
+  uint64_t objects = 0;
+
+  std::cout << "Running " << pool.workerCount() << " detectors with at most "
+    << pool.inFlightLimit() << " frames in flight" << std::endl;
+
+  grabber.start();
+  auto benchmarkstart = Clock::now();
+  while (true)
+  {
+    bool newframe = false;
+    if (maxframes <= 0 || submitted < static_cast<uint64_t>(maxframes))
+    {
+      ScopedTimer timer(Stage::CaptureWait);
+      newframe = grabber.pop(captured, maxframewait);
+      while (!newframe && !grabber.finished())
+      {
+        newframe = grabber.pop(captured, maxframewait);
+      }
+    }
+    if (!newframe && pool.inFlight() == 0)
+    {
+      break;
+    }
+
+    if (newframe)
+    {
+      // results are taken only by this thread, so room has to be made before submitting
+      while (pool.inFlight() >= pool.inFlightLimit())
+      {
+        if (pool.pop(detections, maxframewait))
+        {
+          objects += consumeDetections(detectionsstream, frameindices.front(), detections.objects);
+          frameindices.pop_front();
+          frames++;
+        }
+      }
+      pool.submit(captured.image);
+      frameindices.push_back(captured.index);
+      submitted++;
+    }
+
+    // take the ready results, after the last frame wait for the remaining ones
+    while (pool.pop(detections, newframe ? 0.0 : maxframewait))
+    {
+      objects += consumeDetections(detectionsstream, frameindices.front(), detections.objects);
+      frameindices.pop_front();
+      frames++;
+    }
+  }
+  double elapsed = millisecondsSince(benchmarkstart) / 1000.0;
+  grabber.stop();
+
+  printHeadlessSummary(frames, elapsed, objects, grabber.droppedFrames());
+  std::vector<CropTiming> timings;
+  pool.getCropTimings(timings);
+  if (frames > 0 && !timings.empty())
+  {
+    printTileStatistics(frames, elapsed, static_cast<double>(timings.size()));
+  }
+  printStageStatistics();
+}
+
+void DetectionVisualizer::printTileStatistics(uint64_t frames, double elapsed, double cropsperframe)
+{
+  double crops = cropsperframe * frames;
+  printf("Tiles: %.1f per frame, %.1f tiles/s, inference %.2f ms per tile\n",
+      cropsperframe, elapsed > 0.0 ? crops / elapsed : 0.0, Profiler::snapshot(Stage::Inference).sum / 1000.0 / crops);
+}
+
+void DetectionVisualizer::printHeadlessSummary(uint64_t frames, double elapsed, uint64_t objects, uint64_t dropped)
+{
+  std::cout << std::endl << "Processed " << frames << " frames in " << elapsed << " s ("
+    << (elapsed > 0.0 ? frames / elapsed : 0.0) << " fps), " << objects << " objects above threshold, "
+    << dropped << " frames dropped" << std::endl;
+}
+
+void DetectionVisualizer::printStageStatistics()
+{
+  for (int stage = 0; stage < static_cast<int>(Stage::Count); stage++)
+  {
+    printLatencyStatistics(static_cast<Stage>(stage));
+  }
+}
+
+void DetectionVisualizer::loadFonts()
+{
+  // fonts have to be added before the first frame builds the font atlas
+  ImGuiIO& io = ImGui::GetIO();
+  ImFontConfig mainconfig, filterconfig;
+  mainconfig.SizePixels = fontsize;
+  io.Fonts->AddFontDefault(&mainconfig);
+  filterconfig.SizePixels = filterfontsize;
+  filterfont = io.Fonts->AddFontDefault(&filterconfig);
+}
+
+void DetectionVisualizer::logStartupEvent(const char* event)
+{
+  printf("[startup] %8.1f ms  %s\n", millisecondsSince(startuptime), event);
+  fflush(stdout);
+}
+
+bool DetectionVisualizer::loadingDisplayLoop(std::future<void>& capturetask, std::future<std::unique_ptr<ThreadedDetector>>& detectortask)
 {
   ImGuiWindowFlags windowflags= 0;
   windowflags |= ImGuiWindowFlags_NoTitleBar;
@@ -387,10 +1446,76 @@ void DetectionVisualizer::errorDisplayLoop(std::string errorstring)
   windowflags |= ImGuiWindowFlags_NoSavedSettings;
   windowflags |= ImGuiWindowFlags_NoInputs;
 
-  ImGuiIO& io = ImGui::GetIO();
-  ImFontConfig mainconfig;
-  mainconfig.SizePixels = fontsize;
-  io.Fonts->AddFontDefault(&mainconfig);
+  const char spinner[] = "|/-\\";
+  int spinnerframe = 0;
+  std::string capturestatus = "Opening video source... ";
+  std::string networkstatus = "Loading network... ";
+  bool captureready = false;
+  bool networkready = false;
+
+  while(glfwWindowShouldClose(mainwindow.window) == 0 && glfwGetKey(mainwindow.window, GLFW_KEY_ESCAPE) != GLFW_PRESS)
+  {
+    if(!captureready && capturetask.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+      captureready = true;
+      capturestatus += "done";
+    }
+    if(!networkready && detectortask.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+      networkready = true;
+      networkstatus += "done";
+    }
+    if(captureready && networkready)
+    {
+      return true;
+    }
+
+    glfwPollEvents();
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    ImGui_ImplOpenGL3_NewFrame();
+    ImGui_ImplGlfw_NewFrame();
+    ImGui::NewFrame();
+
+    ImGui::SetNextWindowPos(ImVec2(0, 0));
+    ImGui::SetNextWindowSize(ImVec2(mainwindow.size.width, mainwindow.size.height));
+    if(!ImGui::Begin("Loading window", NULL, windowflags))
+    {
+      perror("Failed to initiate ImGui");
+      ImGui::End();
+      return false;
+    }
+
+    char progresstext[160];
+    snprintf(progresstext, sizeof(progresstext), "%s%c\n%s%c\n%.1f s",
+        capturestatus.c_str(), captureready ? ' ' : spinner[spinnerframe / 8 % 4],
+        networkstatus.c_str(), networkready ? ' ' : spinner[spinnerframe / 8 % 4],
+        millisecondsSince(startuptime) / 1000.0);
+    spinnerframe++;
+
+    ImVec2 textsize = ImGui::CalcTextSize(progresstext);
+    ImGui::SetCursorPosX(std::max((mainwindow.size.width - textsize.x)/2.0f, 3.0f));
+    ImGui::SetCursorPosY((mainwindow.size.height - textsize.y)/2);
+    ImGui::TextUnformatted(progresstext);
+
+    ImGui::End();
+    ImGui::Render();
+    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    glfwSwapBuffers(mainwindow.window);
+  }
+  return false;
+}
+
+void DetectionVisualizer::errorDisplayLoop(std::string errorstring)
+{
+  ImGuiWindowFlags windowflags= 0;
+  windowflags |= ImGuiWindowFlags_NoTitleBar;
+  windowflags |= ImGuiWindowFlags_NoResize;
+  windowflags |= ImGuiWindowFlags_NoMove;
+  windowflags |= ImGuiWindowFlags_NoScrollbar;
+  windowflags |= ImGuiWindowFlags_NoSavedSettings;
+  windowflags |= ImGuiWindowFlags_NoInputs;
 
   while(glfwWindowShouldClose(mainwindow.window) == 0 && glfwGetKey(mainwindow.window, GLFW_KEY_ESCAPE) != GLFW_PRESS)
   {
@@ -425,8 +1550,89 @@ void DetectionVisualizer::errorDisplayLoop(std::string errorstring)
 }
   
 
+void DetectionVisualizer::writeTrace()
+{
+  if (tracefile == "")
+  {
+    return;
+  }
+  try
+  {
+    Tracer::write(tracefile);
+    std::cout << "Trace written to " << tracefile << std::endl;
+  }
+  catch(std::runtime_error& err)
+  {
+    std::cout << err.what() << std::endl;
+  }
+}
+
+int DetectionVisualizer::runHeadless()
+{
+  try
+  {
+    openNamesFile();
+    selectCaptureFormat();
+    if (isMultiStream())
+    {
+      throw std::runtime_error("Multiple video sources are supported only with a window\nUse --help to print usage.");
+    }
+    openVideoSource();
+    logStartupEvent("video source opened");
+    if (cfgfile == "" || weightsfile == "")
+    {
+      throw std::runtime_error("Wrong arguments\nUse --help to print usage.");
+    }
+    if (batchsize < 1 || detectorworkers < 1)
+    {
+      throw std::runtime_error("Batch size and number of detectors have to be at least 1\nUse --help to print usage.");
+    }
+    if (batchsize > 1 && (detectorworkers > 1 || weightscache))
+    {
+      throw std::runtime_error("Batched inference cannot be combined with multiple detectors or the weights cache\nUse --help to print usage.");
+    }
+    selectDropPolicy();
+    selectNmsMode();
+    selectTiling();
+    openRegionsFile();
+    if (detectorworkers > 1 && !regions.empty())
+    {
+      throw std::runtime_error("Regions of interest cannot be combined with multiple detectors\nUse --help to print usage.");
+    }
+
+    Tracer::nameThread("headless");
+    if (detectorworkers > 1)
+    {
+      headlessPoolLoop();
+    }
+    else
+    {
+      headlessLoop();
+    }
+  }
+  catch(std::runtime_error& err)
+  {
+    std::cout << err.what() << std::endl << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // detectors and frame grabbers of the headless loops are destroyed, so their threads are joined by now
+  writeTrace();
+
+  return EXIT_SUCCESS;
+}
+
 int DetectionVisualizer::run()
 { 
+  startuptime = Clock::now();
+  if (tracefile != "")
+  {
+    Tracer::enable();
+  }
+  if (headless)
+  {
+    return runHeadless();
+  }
   if (mainwindow.init(windowname) != EXIT_SUCCESS)
   {
     return EXIT_FAILURE;
@@ -436,39 +1642,36 @@ int DetectionVisualizer::run()
     return EXIT_FAILURE;
   }
   mainwindow.setFullScreen(fullscreen);
+  loadFonts();
+  logStartupEvent("window created");
 
   try
   {
     openNamesFile();
-    if (cameraID >= 0)
+    selectCaptureFormat();
+  
+    if (cfgfile == "" || weightsfile == "")
     {
-      if ("" == videofilepath)
-      {
-        std::cout << "openning camera no. " << cameraID << std::endl;
-        cameraInputInit();
-      }
-      else
-      {
-        throw std::runtime_error("Too many parameters\nUse --help to print usage.");
-      }
+      throw std::runtime_error("Wrong arguments\nUse --help to print usage.");
     }
-    else
+    if ((batchsize != 1 && tilesname == "") || detectorworkers != 1 || detectionsfile != "")
     {
-      if ("" == videofilepath)
-      {
-        throw std::runtime_error("Correct video source parameters not specified\nUse --help to print usage.");
-      }
-      else
-      {
-        std::cout << "openning videofile: " << videofilepath << std::endl;
-        videoInputInit();
-      }
+      throw std::runtime_error("Batched inference without tiles, multiple detectors and detections file are supported only in headless mode\nUse --help to print usage.");
     }
-  
-    if (cfgfile == "" || weightsfile == "")
+    if (batchsize > 1 && weightscache)
     {
-      throw std::runtime_error("Wrong arguments\nUse --help to print usage.");
+      // networks mapped from the cache run one tile at a time
+      throw std::runtime_error("Batched inference cannot be combined with the weights cache\nUse --help to print usage.");
     }
+    if (!streampriorities.empty() && streampriorities.size() != cameraids.size() + videofilepaths.size())
+    {
+      throw std::runtime_error("Number of stream priorities does not match the number of streams\nUse --help to print usage.");
+    }
+    selectDropPolicy();
+    selectSkipMode();
+    selectNmsMode();
+    selectTiling();
+    openRegionsFile();
   }
   catch(std::runtime_error& err)
   {
@@ -482,14 +1685,70 @@ int DetectionVisualizer::run()
   for(int i = 0; i < objectnames.size(); i++)
     objectcolors.push_back(ImColor(ImVec4(dis(rng), dis(rng), dis(rng), 1.0f)));
 
-  glGenTextures(1, &textureID);
-  glBindTexture(GL_TEXTURE_2D, textureID);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  // the network and the video source are opened in the background while the window shows progress
+  std::future<void> capturetask = std::async(std::launch::async, [this] {
+    if (isMultiStream())
+    {
+      openVideoStreams();
+    }
+    else
+    {
+      openVideoSource();
+    }
+    logStartupEvent("video source opened");
+  });
+  std::future<std::unique_ptr<ThreadedDetector>> detectortask = std::async(std::launch::async, [this] {
+    // in the window, the batch holds tiles of a single frame
+    auto detector = std::make_unique<ThreadedDetector>(cfgfile, weightsfile, letterbox, captureformat, tiling.enabled() ? batchsize : 1, weightsCacheDirectory());
+    detector->setTiling(tiling);
+    if (isMultiStream())
+    {
+      std::vector<int> priorities = streampriorities;
+      priorities.resize(cameraids.size() + videofilepaths.size(), 1);
+      detector->setStreams(priorities);
+    }
+    logStartupEvent("network loaded");
+    return detector;
+  });
+
+  Tracer::nameThread("render");
+  bool loaded = loadingDisplayLoop(capturetask, detectortask);
 
-  detectDisplayLoop();
-  
-  glDeleteTextures(1, &textureID);
+  std::unique_ptr<ThreadedDetector> detector;
+  try
+  {
+    capturetask.get();
+    detector = detectortask.get();
+  }
+  catch(std::runtime_error& err)
+  {
+    if (loaded)
+    {
+      errorDisplayLoop(err.what());
+    }
+    std::cout << err.what() << std::endl << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!loaded)
+  {
+    return EXIT_SUCCESS;
+  }
+  logStartupEvent("startup finished");
+
+  if (isMultiStream())
+  {
+    mainwindow.updateContentSize(streamGridSize());
+    multiStreamDisplayLoop(*detector);
+  }
+  else
+  {
+    mainwindow.updateContentSize(sourceresolution);
+    detectDisplayLoop(*detector);
+  }
+  // the trace is written only after every recording thread finished: the capture task was joined above,
+  // frame grabbers are stopped when the display loops return and the detection thread is joined here
+  detector.reset();
+  writeTrace();
 
   return EXIT_SUCCESS;
 }
@@ -9,7 +9,13 @@
 #include <cctype>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <deque>
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -20,84 +26,19 @@
 
 #include <opencv2/opencv.hpp>
 
-#define OPENCV
-#include "yolo_v2_class.hpp"
-
 #include "Window.hpp"
-
-/**
- * Wrapper for YOLO detector that runs inference in separate thread
- */
-class ThreadedDetector
-{
-public:
- /**
-  * Creates and runs YOLO detector in new thread
-  * @param cfgfile - path to the config file defining model
-  * @param weightsfile - path to the file containing weights
-  */
-  ThreadedDetector(std::string& cfgfile, std::string& weightsfile);
-  
-  /**
-   * Stops and destroys running thread 
-   */
-  ~ThreadedDetector();
-
-  /**
-   * Atomically sets frame.
-   *
-   * @param newframe new frame to detect
-   */
-  void setFrame(cv::Mat newframe);
-
-  /**
-   * Returns the frame (thread-safe).
-   *
-   * @return current frame
-   */
-  cv::Mat getFrame(void);
-
-  /**
-   * Updates detection results.
-   *
-   * @param detected found objects
-   */
-  void setDetectedObjects(std::vector<bbox_t> detected);
-
-  /**
-   * Returns detected objects
-   *
-   * @return detected objects
-   */
-  std::vector<bbox_t> getDetectedObjects();
-
-  /**
-   * Tells if the detection is running.
-   *
-   * @return true if detection is still running
-   */
-  bool isRunning();
-
-  /**
-   * Starts the detection thread
-   */
-  void startThread();
-  
-  std::atomic<double> inferencetime;
-
-private:
-  void detectLoop();
-
-  std::mutex framemutex;
-  std::mutex detectedobjectsmutex;
-
-  Detector detector;
-  std::thread thr;
-
-  cv::Mat frame;
-  std::vector<bbox_t> detectedobjects;
-  std::atomic<bool> running = false;
-};
+#include "ThreadedDetector.hpp"
+#include "DetectorPool.hpp"
+#include "FrameGrabber.hpp"
+#include "TextureStreamer.hpp"
+#include "FrameSkipScheduler.hpp"
+#include "ObjectTracker.hpp"
+#include "DelayedDisplay.hpp"
+#include "ClassFilter.hpp"
+#include "Profiler.hpp"
+#include "Tracer.hpp"
+#include "ProfilerPanel.hpp"
+#include "MemoryUsage.hpp"
 
 
 class DetectionVisualizer
@@ -124,10 +65,42 @@ private:
   Window mainwindow;
   cv::VideoCapture capture;
   bool fullscreen = false;  
+  bool headless = false;
+  bool sourcerate = false;
+  int maxframes = 0;
+  int batchsize = 1;
+  int detectorworkers = 1;
+  int maxinflight = 0;
+  bool shareweights = false;
+  bool weightscache = false;
+  std::string weightscachedirectory = "";
+  std::string detectionsfile = "";
 
   int cameraID = -1;
   std::string videofilepath = "";
+  std::vector<int> cameraids;
+  std::vector<std::string> videofilepaths;
+  std::vector<int> streampriorities;
   cv::Size userspecifiedresolution{0, 0};
+  cv::Size sourceresolution{0, 0};
+  std::chrono::steady_clock::time_point startuptime;
+
+  std::string droppolicyname = "";
+  DropPolicy droppolicy = DropPolicy::Block;
+  int capturequeuesize = 3;
+  std::string captureformatname = "bgr";
+  PixelFormat captureformat = PixelFormat::BGR;
+  bool letterbox = false;
+  std::string skipmodename = "latest";
+  SkipMode skipmode = SkipMode::LatestOnly;
+  float targetlatency = 0.0f;
+  bool synchronizedoverlay = false;
+  int synchronizedframes = 8;
+  bool tracking = false;
+  bool trackingflow = false;
+  bool showprofiler = false;
+  std::string tracefile = "";
+  const double maxframewait = 1.0 / 60.0;
   
   std::string namesfile = "";
   std::string cfgfile = "";
@@ -135,38 +108,308 @@ private:
   
   std::vector<std::string> objectnames;
   std::vector<ImU32> objectcolors;
+  std::vector<bool> visibleobjects;
 
-  GLuint textureID;
+  int pixelbuffers = 3;
+  bool disablepersistentmapping = false;
   ImVec2 frameratetextsize; 
   const ImU32 frameratecolor = ImColor(ImVec4(1.0f, 1.0f, 0.4f, 1.0f));
   const ImVec4 hiddenobjectcolor = ImVec4(0.5f, 0.5f, 0.5f, 1.0f);
+  const ImU32 regioncolor = ImColor(ImVec4(0.2f, 0.9f, 1.0f, 1.0f));
   const float cornerroundingfactor = 10.0f;
   const float perimeterthickness = 8.0f;
   const float fontsize = 25.0f;
   const float filterfontsize = 15.0f;
+  ImFont* filterfont = nullptr;
   float threshold = 0.2f;
+  std::string filterclass;
+  ClassFilter classfilter;
+  bool filterindetector = false;
+  std::string nmsmodename = "class";
+  NmsSettings nmssettings;
+  std::string tilesname;
+  bool tilesonly = false;
+  TilingSettings tiling;
+  std::string roifile;
+  RegionsOfInterest regions;
+  bool editingregions = false;
+  std::vector<cv::Point2f> regiondraft;
+  std::vector<ImVec2> regionpoints;
+  std::vector<CropTiming> croptimings;
 
   const int seed = 12345;
 
   /**
-   * Initiates video capture from specified camera along with setting proper resolution of frames to be read from capture object
+   * Video source of the multi-stream mode along with its capture thread and texture
+   */
+  struct VideoStream
+  {
+    std::string name;
+    cv::VideoCapture capture;
+    cv::Size sourceresolution{0, 0};
+    DropPolicy droppolicy = DropPolicy::Block;
+    std::unique_ptr<FrameGrabber> grabber;
+    std::unique_ptr<TextureStreamer> texturestreamer;
+    CapturedFrame captured;
+    cv::Size sourcesize{0, 0};
+    bool finished = false;
+  };
+
+  // deque keeps streams in place, as frame grabbers refer to their capture objects
+  std::deque<VideoStream> streams;
+
+  /**
+   * Initiates video capture from specified camera along with setting proper resolution of frames to be read from capture object.
+   * The resolution is returned, so that the window can be updated from the render thread.
+   * @param capture capture object to open
+   * @param cameraid number of the camera in the system
+   * @return resolution of captured frames
+   */
+  cv::Size cameraInputInit(cv::VideoCapture& capture, int cameraid);
+
+  /**
+   * Initiates video capture from specified video file along with scaling down frames to be read from capture object if they won't fit the screen.
+   * The resolution is returned, so that the window can be updated from the render thread.
+   * @param capture capture object to open
+   * @param path path to the video file
+   * @return resolution of displayed frames
+   */
+  cv::Size videoInputInit(cv::VideoCapture& capture, const std::string& path);
+
+  /**
+   * Selects the drop policy of the capture thread based on droppolicyname and the type of video source
+   */
+  void selectDropPolicy(void);
+
+  /**
+   * Selects the pixel layout of decoded frames based on captureformatname
+   */
+  void selectCaptureFormat(void);
+
+  /**
+   * Selects the frame skipping strategy of the render loop based on skipmodename
+   */
+  void selectSkipMode(void);
+
+  /**
+   * Selects the non-maximum suppression of detected boxes based on nmsmodename
+   */
+  void selectNmsMode(void);
+
+  /**
+   * Draws the suppression mode, IoU threshold and Soft-NMS controls in the current window
+   */
+  void nmsControls();
+
+  /**
+   * Draws the class filter, probability threshold and suppression controls shared by all render loops in the current window
+   */
+  void filterControls();
+
+  /**
+   * Post-processing settings last passed to the detector by a render loop
+   */
+  struct PushedSettings
+  {
+    uint64_t maskversion = 0;
+    NmsSettings nms;
+  };
+
+  /**
+   * Passes the class mask and suppression settings to the detector if they changed since the last call.
+   *
+   * @param detector detector of the render loop
+   * @param pushed settings passed by the previous call, updated
+   */
+  void pushDetectorSettings(ThreadedDetector& detector, PushedSettings& pushed);
+
+  /**
+   * Draws a line of status text in the lower right corner of the frame window, above the lines drawn before.
+   *
+   * @param drawlist draw list of the frame window
+   * @param windowposition position of the frame window
+   * @param text text of the line
+   * @param height total height of the lines drawn before, increased by the height of this line
+   */
+  void drawStatusText(ImDrawList* drawlist, cv::Size windowposition, const char* text, float& height);
+
+  /**
+   * Sets the splitting of frames into tiles based on tilesname and tilesonly
+   */
+  void selectTiling(void);
+
+  /**
+   * Loads regions of interest from roifile, if it is given and exists
    */
-  void cameraInputInit(void);
+  void openRegionsFile(void);
 
   /**
-   * Initiates video capture from specified video file along with scaling down frames to be read from capture object if they won't fit the screen
+   * Draws outlines of the regions of interest and, while editing, the region being drawn.
+   *
+   * @param drawlist draw list of the overlay window
+   * @param origin screen position of the frame's upper left corner
+   * @param scalex horizontal scale from source frame pixels to screen
+   * @param scaley vertical scale from source frame pixels to screen
+   */
+  void drawRegions(ImDrawList* drawlist, ImVec2 origin, float scalex, float scaley);
+
+  /**
+   * While editing, adds a vertex of the drawn region on left click and closes the region on right click.
+   *
+   * @param origin screen position of the frame's upper left corner
+   * @param scalex horizontal scale from source frame pixels to screen
+   * @param scaley vertical scale from source frame pixels to screen
+   * @param framesize size of the source frame, vertices are clamped to it
    */
-  void videoInputInit(void);
+  void editRegions(ImVec2 origin, float scalex, float scaley, cv::Size framesize);
+
+  /**
+   * Draws region editing buttons, pixels saved by cropping and inference time of every crop in the current window.
+   *
+   * @param framesize size of the source frame
+   */
+  void regionControls(cv::Size framesize);
 
   /**
    * Opens a file specified in namesfile variable and loads its contents into objectnames vector.
    */ 
   void openNamesFile(void);
 
+  /**
+   * Returns the directory of the weights cache, empty if the cache is disabled
+   */
+  std::string weightsCacheDirectory(void);
+
+  /**
+   * Opens camera or video file depending on parsed arguments
+   */
+  void openVideoSource(void);
+
+  /**
+   * Tells if more than one video source was given, which enables the multi-stream mode.
+   */
+  bool isMultiStream(void);
+
+  /**
+   * Opens all cameras and video files of the multi-stream mode.
+   */
+  void openVideoStreams(void);
+
+  /**
+   * Returns the content size of the grid the streams are displayed in.
+   */
+  cv::Size streamGridSize(void);
+
+  /**
+   * Marks detections above the probability threshold whose class passes the filter compiled from filterclass in visibleobjects.
+   * @param objects detections of the current frame
+   */
+  void filterDetections(const std::vector<bbox_t>& objects);
+
   /**
    * Runs a loop which detects objects in each frame and displays result.
+   * @param detector loaded detector, its thread is started with the first frame
+   */
+  void detectDisplayLoop(ThreadedDetector& detector);
+
+  /**
+   * Runs a loop which displays all streams in a grid, each with its own texture and detections.
+   * A single detector is shared by all streams.
+   * @param detector loaded detector configured with one slot per stream, its thread is started with the first frame
+   */
+  void multiStreamDisplayLoop(ThreadedDetector& detector);
+
+  /**
+   * Draws boxes and labels of detections marked in visibleobjects by filterDetections.
+   * @param drawlist target draw list
+   * @param objects detections in source frame coordinates
+   * @param origin position of the upper left corner of the frame in the window
+   * @param scalex horizontal scale from the source frame to the window
+   * @param scaley vertical scale from the source frame to the window
+   */
+  void drawDetections(ImDrawList* drawlist, const std::vector<bbox_t>& objects, ImVec2 origin, float scalex, float scaley);
+
+  /**
+   * Adds fonts used by all render loops to the ImGui font atlas.
+   */
+  void loadFonts(void);
+
+  /**
+   * Prints the time elapsed since the start of run() along with the startup event (thread-safe).
+   * @param event description of the event
+   */
+  void logStartupEvent(const char* event);
+
+  /**
+   * Runs a render loop displaying startup progress until both background tasks finish.
+   * @param capturetask task opening the video source
+   * @param detectortask task loading the network
+   * @return false if the window was closed before the tasks finished
+   */
+  bool loadingDisplayLoop(std::future<void>& capturetask, std::future<std::unique_ptr<ThreadedDetector>>& detectortask);
+
+  /**
+   * Runs capture, preprocessing, inference and post-processing without a window
+   * and prints per-stage latency statistics and throughput.
+   * Frames are grouped into batches of batchsize frames for a single network run.
+   */
+  void headlessLoop(void);
+
+  /**
+   * Runs the headless pipeline with a pool of detectorworkers detectors processing frames in parallel,
+   * results are consumed in capture order.
+   */
+  void headlessPoolLoop(void);
+
+  /**
+   * Prints the number of processed frames and throughput of a headless run.
+   * @param frames number of processed frames
+   * @param elapsed duration of the run in seconds
+   * @param objects number of detections above the threshold
+   * @param dropped number of frames dropped by the capture thread
+   */
+  void printHeadlessSummary(uint64_t frames, double elapsed, uint64_t objects, uint64_t dropped);
+
+  /**
+   * Prints the number of crops or tiles detected per frame and their throughput.
+   * @param frames number of processed frames
+   * @param elapsed processing time in seconds
+   * @param cropsperframe average number of crops of a frame
+   */
+  void printTileStatistics(uint64_t frames, double elapsed, double cropsperframe);
+
+  /**
+   * Prints latency statistics of all stages recorded by the profiler.
+   */
+  void printStageStatistics(void);
+
+  /**
+   * Counts detections above the threshold and writes them to the stream if it is open.
+   * @param stream detections file stream
+   * @param frameindex index of the frame in the video source
+   * @param objects detections of the frame
+   * @return number of detections above the threshold
+   */
+  uint64_t consumeDetections(std::ofstream& stream, uint64_t frameindex, const std::vector<bbox_t>& objects);
+
+  /**
+   * Writes detections above the threshold as a single JSON line.
+   * @param stream output stream
+   * @param frameindex index of the frame in the video source
+   * @param objects detections of the frame
+   */
+  void writeDetections(std::ostream& stream, uint64_t frameindex, const std::vector<bbox_t>& objects);
+
+  /**
+   * Writes events recorded by the tracer to tracefile, if it was given.
+   */
+  void writeTrace(void);
+
+  /**
+   * Runs the pipeline in headless mode.
+   * @return EXIT_SUCCESS if executed successfully
    */
-  void detectDisplayLoop(void);
+  int runHeadless(void);
 
   /**
    * Runs a render loop displaying error message.
@@ -0,0 +1,181 @@
+#include "DetectorPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "MemoryUsage.hpp"
+
+#include "Tracer.hpp"
+
+DetectorPool::DetectorPool(std::string& cfgfile, std::string& weightsfile, int workers, int inflight, bool letterbox, PixelFormat format, bool shareweights, const std::string& cachedirectory) :
+  inflightlimit(std::max(inflight, std::max(workers, 1)))
+{
+  size_t memory = residentMemory();
+  std::shared_ptr<const NetworkWeights> weights;
+  if (shareweights || cachedirectory != "")
+  {
+    auto start = std::chrono::steady_clock::now();
+    weights = std::make_shared<const NetworkWeights>(cfgfile, weightsfile, cachedirectory);
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    size_t loaded = residentMemory();
+    std::cout << "Shared weights: loaded in " << elapsed << " ms, resident memory " << (static_cast<double>(loaded) - memory) / (1 << 20) << " MiB" << std::endl;
+    memory = loaded;
+  }
+  for (int worker = 0; worker < std::max(workers, 1); worker++)
+  {
+    if (weights)
+    {
+      detectors.push_back(std::make_unique<ThreadedDetector>(weights, letterbox, format));
+    }
+    else
+    {
+      detectors.push_back(std::make_unique<ThreadedDetector>(cfgfile, weightsfile, letterbox, format));
+    }
+    size_t loaded = residentMemory();
+    std::cout << "Detector " << worker << ": resident memory +" << (static_cast<double>(loaded) - memory) / (1 << 20)
+      << " MiB, total " << static_cast<double>(loaded) / (1 << 20) << " MiB" << std::endl;
+    memory = loaded;
+  }
+  freeframes.resize(inflightlimit);
+  for (int worker = 0; worker < workerCount(); worker++)
+  {
+    threads.emplace_back([this, worker] { this->workerLoop(worker); });
+  }
+}
+
+DetectorPool::~DetectorPool()
+{
+  {
+    std::lock_guard<std::mutex> guard(poolmutex);
+    running = false;
+  }
+  jobcondition.notify_all();
+  spacecondition.notify_all();
+  resultcondition.notify_all();
+  for (std::thread& thread : threads)
+  {
+    thread.join();
+  }
+}
+
+uint64_t DetectorPool::submit(const cv::Mat& frame)
+{
+  std::unique_lock<std::mutex> lock(poolmutex);
+  spacecondition.wait(lock, [this] { return !running || submitted - delivered < inflightlimit; });
+  if (!running)
+  {
+    return 0;
+  }
+  // the number of frames in flight is bounded, so a free buffer is always available
+  Job job;
+  job.sequence = ++submitted;
+  uint64_t sequence = job.sequence;
+  job.frame = std::move(freeframes.back());
+  freeframes.pop_back();
+  lock.unlock();
+
+  // copying outside of the lock lets workers take jobs in the meantime
+  frame.copyTo(job.frame);
+
+  lock.lock();
+  jobs.push_back(std::move(job));
+  lock.unlock();
+  jobcondition.notify_one();
+  return sequence;
+}
+
+bool DetectorPool::pop(Detections& result, double timeout)
+{
+  std::unique_lock<std::mutex> lock(poolmutex);
+  if (submitted == delivered)
+  {
+    return false;
+  }
+  bool ready = resultcondition.wait_for(lock, std::chrono::duration<double>(timeout),
+      [this] { return !running || results.count(delivered + 1) > 0; });
+  if (!ready || !running)
+  {
+    return false;
+  }
+  auto next = results.find(delivered + 1);
+  result.sequence = next->first;
+  result.objects = std::move(next->second);
+  results.erase(next);
+  delivered++;
+  lock.unlock();
+  spacecondition.notify_one();
+  return true;
+}
+
+size_t DetectorPool::inFlight()
+{
+  std::lock_guard<std::mutex> guard(poolmutex);
+  return submitted - delivered;
+}
+
+size_t DetectorPool::inFlightLimit() const
+{
+  return inflightlimit;
+}
+
+void DetectorPool::setNmsSettings(const NmsSettings& settings)
+{
+  for (std::unique_ptr<ThreadedDetector>& detector : detectors)
+  {
+    detector->setNmsSettings(settings);
+  }
+}
+
+void DetectorPool::setClassMask(const std::vector<uint64_t>& mask)
+{
+  for (std::unique_ptr<ThreadedDetector>& detector : detectors)
+  {
+    detector->setClassMask(mask);
+  }
+}
+
+void DetectorPool::setTiling(const TilingSettings& settings)
+{
+  for (std::unique_ptr<ThreadedDetector>& detector : detectors)
+  {
+    detector->setTiling(settings);
+  }
+}
+
+void DetectorPool::getCropTimings(std::vector<CropTiming>& timings)
+{
+  detectors.front()->getCropTimings(timings);
+}
+
+int DetectorPool::workerCount() const
+{
+  return static_cast<int>(detectors.size());
+}
+
+void DetectorPool::workerLoop(int worker)
+{
+  std::string name = "detector " + std::to_string(worker);
+  Tracer::nameThread(name.c_str());
+  ThreadedDetector& detector = *detectors[worker];
+  while (true)
+  {
+    std::unique_lock<std::mutex> lock(poolmutex);
+    jobcondition.wait(lock, [this] { return !running || !jobs.empty(); });
+    if (!running)
+    {
+      return;
+    }
+    Job job = std::move(jobs.front());
+    jobs.pop_front();
+    lock.unlock();
+
+    std::vector<bbox_t> objects = detector.detect(job.frame);
+
+    lock.lock();
+    results[job.sequence] = std::move(objects);
+    freeframes.push_back(std::move(job.frame));
+    lock.unlock();
+    resultcondition.notify_all();
+  }
+}
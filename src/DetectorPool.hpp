@@ -0,0 +1,142 @@
+#ifndef DETECTORPOOL_H
+#define DETECTORPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "ThreadedDetector.hpp"
+
+/**
+ * Pool of detectors, each with its own network and thread, pulling frames from a shared work queue.
+ * Workers either load their own copy of the weights or share a single read-only copy.
+ *
+ * Frames are numbered in submission order and results are handed out in the same order,
+ * regardless of which worker finishes first. The number of frames submitted but not yet
+ * returned by pop() is bounded, so a fast source cannot queue an unbounded number of frames.
+ */
+class DetectorPool
+{
+public:
+  /**
+   * Loads the network once per worker and starts the worker threads
+   * @param cfgfile - path to the config file defining model
+   * @param weightsfile - path to the file containing weights
+   * @param workers - number of detectors running in parallel
+   * @param inflight - maximum number of frames submitted and not yet popped, at least workers
+   * @param letterbox - if true, frames are letterboxed instead of stretched to the network input
+   * @param format - pixel layout of submitted frames
+   * @param shareweights - if true, weights are loaded once and shared by all workers
+   * @param cachedirectory - if not empty, shared weights are mapped from the weights cache in this directory
+   */
+  DetectorPool(std::string& cfgfile, std::string& weightsfile, int workers, int inflight, bool letterbox = false, PixelFormat format = PixelFormat::BGR, bool shareweights = false, const std::string& cachedirectory = "");
+
+  /**
+   * Stops and joins worker threads, pending frames are discarded
+   */
+  ~DetectorPool();
+
+  /**
+   * Copies the frame into the work queue, waits while the in-flight limit is reached.
+   *
+   * @param frame decoded frame
+   * @return sequence number assigned to the frame, starting from 1
+   */
+  uint64_t submit(const cv::Mat& frame);
+
+  /**
+   * Takes the result of the oldest submitted frame not returned yet.
+   *
+   * @param result receives detections and the sequence number of the frame
+   * @param timeout maximum time to wait for the result, in seconds
+   * @return true if a result was returned, false on timeout or when nothing is in flight
+   */
+  bool pop(Detections& result, double timeout);
+
+  /**
+   * Returns the number of frames submitted and not yet popped (thread-safe).
+   *
+   * @return number of frames in flight
+   */
+  size_t inFlight();
+
+  /**
+   * Returns the maximum number of frames in flight.
+   *
+   * @return in-flight limit
+   */
+  size_t inFlightLimit() const;
+
+  /**
+   * Sets the non-maximum suppression applied by every worker (thread-safe).
+   *
+   * @param settings suppression parameters
+   */
+  void setNmsSettings(const NmsSettings& settings);
+
+  /**
+   * Sets the classes kept by every worker right after inference (thread-safe).
+   *
+   * @param mask classes to keep, see ClassFilter, empty keeps all
+   */
+  void setClassMask(const std::vector<uint64_t>& mask);
+
+  /**
+   * Sets the splitting of frames into tiles used by every worker (thread-safe).
+   *
+   * Every frame is tiled by the worker processing it, so tiles of different frames run in parallel.
+   *
+   * @param settings number, size and overlap of tiles
+   */
+  void setTiling(const TilingSettings& settings);
+
+  /**
+   * Copies the crops of the last frame tiled by the first worker along with their inference times.
+   *
+   * @param timings receives one entry per crop, empty when frames are not tiled
+   */
+  void getCropTimings(std::vector<CropTiming>& timings);
+
+  /**
+   * Returns the number of worker threads.
+   *
+   * @return number of detectors
+   */
+  int workerCount() const;
+
+private:
+  struct Job
+  {
+    uint64_t sequence = 0;
+    cv::Mat frame;
+  };
+
+  void workerLoop(int worker);
+
+  std::mutex poolmutex;
+  std::condition_variable jobcondition;
+  std::condition_variable resultcondition;
+  std::condition_variable spacecondition;
+
+  std::vector<std::unique_ptr<ThreadedDetector>> detectors;
+  std::vector<std::thread> threads;
+
+  std::deque<Job> jobs;
+  std::vector<cv::Mat> freeframes;
+  std::map<uint64_t, std::vector<bbox_t>> results;
+  size_t inflightlimit;
+  uint64_t submitted = 0;
+  uint64_t delivered = 0;
+  bool running = true;
+};
+
+#endif
@@ -0,0 +1,142 @@
+#include "FrameGrabber.hpp"
+
+#include <chrono>
+
+#include "Profiler.hpp"
+#include "Tracer.hpp"
+
+FrameGrabber::FrameGrabber(cv::VideoCapture& capture, size_t queuesize, DropPolicy policy) :
+  capture(capture),
+  policy(policy),
+  ring(std::max<size_t>(queuesize, 1))
+{}
+
+void FrameGrabber::setPacing(double framerate)
+{
+  frameinterval = framerate > 0.0 ? 1.0 / framerate : 0.0;
+}
+
+void FrameGrabber::start()
+{
+  running = true;
+  thr = std::thread([this] { this->captureLoop(); });
+}
+
+void FrameGrabber::stop()
+{
+  {
+    std::lock_guard<std::mutex> guard(queuemutex);
+    running = false;
+  }
+  spacecondition.notify_all();
+  if(thr.joinable())
+  {
+    thr.join();
+  }
+}
+
+void FrameGrabber::captureLoop()
+{
+  Tracer::nameThread("capture");
+  CapturedFrame decoded;
+  uint64_t index = 0;
+  auto starttime = std::chrono::steady_clock::now();
+  while(running)
+  {
+    auto decodestart = std::chrono::steady_clock::now();
+    capture.read(decoded.image);
+    auto decodeend = std::chrono::steady_clock::now();
+    decoded.decodetime = std::chrono::duration<double>(decodeend - decodestart).count();
+    Profiler::record(Stage::Decode, decodestart, decodeend);
+    decoded.index = index++;
+    decoded.capturetime = decodeend;
+    if(frameinterval > 0.0)
+    {
+      std::this_thread::sleep_until(starttime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(decoded.index * frameinterval)));
+      decoded.capturetime = std::chrono::steady_clock::now();
+    }
+
+    std::unique_lock<std::mutex> lock(queuemutex);
+    if(decoded.image.empty())
+    {
+      endofstream = true;
+      lock.unlock();
+      framecondition.notify_all();
+      return;
+    }
+    if(count == ring.size())
+    {
+      if(policy == DropPolicy::Block)
+      {
+        spacecondition.wait(lock, [this] { return !running || count < ring.size(); });
+        if(!running)
+        {
+          return;
+        }
+      }
+      else
+      {
+        head = (head + 1) % ring.size();
+        count--;
+        dropped++;
+      }
+    }
+    CapturedFrame& slot = ring[(head + count) % ring.size()];
+    std::swap(slot.image, decoded.image);
+    slot.index = decoded.index;
+    slot.decodetime = decoded.decodetime;
+    slot.capturetime = decoded.capturetime;
+    count++;
+    lock.unlock();
+    framecondition.notify_one();
+  }
+}
+
+bool FrameGrabber::pop(CapturedFrame& frame, double timeout)
+{
+  std::unique_lock<std::mutex> lock(queuemutex);
+  if(!framecondition.wait_for(lock, std::chrono::duration<double>(timeout),
+        [this] { return count > 0 || endofstream; })
+      || count == 0)
+  {
+    return false;
+  }
+  CapturedFrame& slot = ring[head];
+  std::swap(frame.image, slot.image);
+  frame.index = slot.index;
+  frame.decodetime = slot.decodetime;
+  frame.capturetime = slot.capturetime;
+  head = (head + 1) % ring.size();
+  count--;
+  lock.unlock();
+  spacecondition.notify_one();
+  return true;
+}
+
+bool FrameGrabber::finished()
+{
+  std::lock_guard<std::mutex> guard(queuemutex);
+  return endofstream && count == 0;
+}
+
+size_t FrameGrabber::queueDepth()
+{
+  std::lock_guard<std::mutex> guard(queuemutex);
+  return count;
+}
+
+size_t FrameGrabber::queueCapacity() const
+{
+  return ring.size();
+}
+
+uint64_t FrameGrabber::droppedFrames() const
+{
+  return dropped;
+}
+
+FrameGrabber::~FrameGrabber()
+{
+  stop();
+}
@@ -0,0 +1,130 @@
+#ifndef FRAMEGRABBER_H
+#define FRAMEGRABBER_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * Policy applied when frames are decoded faster than they are consumed
+ */
+enum class DropPolicy
+{
+  DropOldest, ///< the oldest queued frame is discarded, suited for live cameras
+  Block       ///< decoding waits for free space in the queue, suited for video files
+};
+
+/**
+ * Decoded frame along with its position in the captured stream
+ */
+struct CapturedFrame
+{
+  cv::Mat image;
+  uint64_t index = 0;
+  double decodetime = 0.0; ///< time spent reading the frame from the capture object, in seconds
+  std::chrono::steady_clock::time_point capturetime; ///< time the frame was read, or released when paced
+};
+
+/**
+ * Reads frames from video capture in a separate thread into a bounded ring of decoded frames
+ */
+class FrameGrabber
+{
+public:
+  /**
+   * Creates the grabber, the capture thread is started with start()
+   * @param capture - opened video capture object, owned by the caller
+   * @param queuesize - number of decoded frames kept in the ring
+   * @param policy - behaviour when the ring is full
+   */
+  FrameGrabber(cv::VideoCapture& capture, size_t queuesize, DropPolicy policy);
+
+  /**
+   * Stops and destroys running thread
+   */
+  ~FrameGrabber();
+
+  /**
+   * Limits the rate at which frames are queued, to replay video files at their own rate.
+   * Has to be called before start().
+   *
+   * @param framerate frames per second, 0 disables the limit
+   */
+  void setPacing(double framerate);
+
+  /**
+   * Starts the capture thread
+   */
+  void start();
+
+  /**
+   * Stops the capture thread and waits for it to finish
+   */
+  void stop();
+
+  /**
+   * Takes the oldest decoded frame from the ring.
+   *
+   * Image buffers are swapped between the ring and the passed frame, so no pixels are copied.
+   *
+   * @param frame receives the decoded frame
+   * @param timeout maximum time in seconds to wait for a frame
+   * @return true if a frame was taken
+   */
+  bool pop(CapturedFrame& frame, double timeout);
+
+  /**
+   * Tells if the stream has ended and all decoded frames were consumed.
+   *
+   * @return true if no more frames will be returned
+   */
+  bool finished();
+
+  /**
+   * Returns the number of decoded frames waiting in the ring (thread-safe).
+   *
+   * @return current queue depth
+   */
+  size_t queueDepth();
+
+  /**
+   * Returns the capacity of the ring.
+   *
+   * @return maximum queue depth
+   */
+  size_t queueCapacity() const;
+
+  /**
+   * Returns the number of frames discarded due to the DropOldest policy.
+   *
+   * @return dropped frames count
+   */
+  uint64_t droppedFrames() const;
+
+private:
+  void captureLoop();
+
+  cv::VideoCapture& capture;
+  DropPolicy policy;
+  double frameinterval = 0.0;
+
+  std::mutex queuemutex;
+  std::condition_variable spacecondition;
+  std::condition_variable framecondition;
+  std::vector<CapturedFrame> ring;
+  size_t head = 0;
+  size_t count = 0;
+  bool endofstream = false;
+
+  std::thread thr;
+  std::atomic<bool> running = false;
+  std::atomic<uint64_t> dropped = 0;
+};
+
+#endif
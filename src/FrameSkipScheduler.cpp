@@ -0,0 +1,133 @@
+#include "FrameSkipScheduler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+FrameSkipScheduler::FrameSkipScheduler(SkipMode mode, double targetlatency) :
+  mode(mode),
+  targetlatency(targetlatency)
+{}
+
+void FrameSkipScheduler::update(uint64_t completed, double inferencetime, Clock::time_point now)
+{
+  if (completed == completedsequence)
+  {
+    return;
+  }
+  completedsequence = completed;
+  if (inferencetime > 0.0)
+  {
+    inferenceestimate = inferenceestimate > 0.0 ? inferenceestimate + smoothing * (inferencetime - inferenceestimate) : inferencetime;
+  }
+  if (pending && !isIdle())
+  {
+    // the detector moved on to the pending frame
+    inferencestart = now;
+  }
+  pending = false;
+}
+
+bool FrameSkipScheduler::shouldSubmit(uint64_t frameindex, Clock::time_point arrival)
+{
+  if (hasarrival && frameindex > lastframeindex)
+  {
+    double interval = std::chrono::duration<double>(arrival - lastarrival).count() / (frameindex - lastframeindex);
+    frameinterval = frameinterval > 0.0 ? frameinterval + smoothing * (interval - frameinterval) : interval;
+  }
+  lastframeindex = frameindex;
+  lastarrival = arrival;
+
+  bool submit = true;
+  if (mode == SkipMode::EveryNth && lastsubmittedsequence > 0)
+  {
+    submit = frameindex - lastsubmittedindex >= static_cast<uint64_t>(skipInterval());
+  }
+  if (submit && !isIdle() && targetlatency > 0.0 && predictedLatency(arrival) > targetlatency)
+  {
+    submit = false;
+  }
+  // the first frame of the stream is always submitted
+  submit = submit || !hasarrival;
+  hasarrival = true;
+
+  if (!submit)
+  {
+    skipped++;
+  }
+  return submit;
+}
+
+void FrameSkipScheduler::submitted(uint64_t sequence, uint64_t frameindex, Clock::time_point arrival)
+{
+  if (isIdle())
+  {
+    inferencestart = arrival;
+    pending = false;
+  }
+  else
+  {
+    pending = true;
+  }
+  lastsubmittedsequence = sequence;
+  lastsubmittedindex = frameindex;
+
+  Submission& submission = history[sequence % historysize];
+  submission.sequence = sequence;
+  submission.frameindex = frameindex;
+  submission.arrival = arrival;
+}
+
+Staleness FrameSkipScheduler::staleness(uint64_t detectionsequence, uint64_t frameindex, Clock::time_point now) const
+{
+  Staleness result;
+  const Submission& submission = history[detectionsequence % historysize];
+  if (detectionsequence == 0 || submission.sequence != detectionsequence)
+  {
+    return result;
+  }
+  result.frames = frameindex > submission.frameindex ? frameindex - submission.frameindex : 0;
+  result.milliseconds = std::chrono::duration<double, std::milli>(now - submission.arrival).count();
+  return result;
+}
+
+bool FrameSkipScheduler::arrivalTime(uint64_t sequence, Clock::time_point& arrival) const
+{
+  const Submission& submission = history[sequence % historysize];
+  if (sequence == 0 || submission.sequence != sequence)
+  {
+    return false;
+  }
+  arrival = submission.arrival;
+  return true;
+}
+
+int FrameSkipScheduler::skipInterval() const
+{
+  if (frameinterval <= 0.0)
+  {
+    return 1;
+  }
+  // small tolerance keeps rounding errors of the estimates from adding a frame
+  return std::max(1, static_cast<int>(std::ceil(inferenceestimate / frameinterval - 0.01)));
+}
+
+double FrameSkipScheduler::predictedLatency(Clock::time_point now) const
+{
+  if (isIdle())
+  {
+    return inferenceestimate;
+  }
+  // a new frame replaces the pending one and starts when the current inference ends
+  double remaining = inferenceestimate - std::chrono::duration<double>(now - inferencestart).count();
+  return std::max(remaining, 0.0) + inferenceestimate;
+}
+
+uint64_t FrameSkipScheduler::skippedFrames() const
+{
+  return skipped;
+}
+
+bool FrameSkipScheduler::isIdle() const
+{
+  return completedsequence == lastsubmittedsequence;
+}
@@ -0,0 +1,147 @@
+#ifndef FRAMESKIPSCHEDULER_H
+#define FRAMESKIPSCHEDULER_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * Strategy of selecting frames passed to the detector
+ */
+enum class SkipMode
+{
+  LatestOnly, ///< every frame is offered, the detector takes the newest one when it becomes free
+  EveryNth    ///< every Nth frame is offered, N adapts so that the detector is free when the frame arrives
+};
+
+/**
+ * Age of displayed detections, measured both in source frames and in time
+ */
+struct Staleness
+{
+  uint64_t frames = 0;       ///< source frames between the detected frame and the displayed frame
+  double milliseconds = 0.0; ///< milliseconds elapsed since the detected frame was received
+};
+
+/**
+ * Decides which frames are passed to the detector so that detections lag behind the video by a bounded amount.
+ *
+ * The scheduler estimates the inference time and the source frame interval, and predicts the latency
+ * of a frame submitted now as the remaining inference of the current frame plus its own inference.
+ * Frames whose predicted latency exceeds the target latency are skipped, unless the detector is idle.
+ * Used only by the render thread.
+ */
+class FrameSkipScheduler
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  /**
+   * Creates the scheduler
+   * @param mode - frame selection strategy
+   * @param targetlatency - maximum predicted latency of a submitted frame in seconds, 0 disables the limit
+   */
+  FrameSkipScheduler(SkipMode mode = SkipMode::LatestOnly, double targetlatency = 0.0);
+
+  /**
+   * Updates estimates with the latest results of the detector, called once per rendered frame.
+   *
+   * @param completedsequence sequence number of the frame the latest detections were computed on
+   * @param inferencetime duration of the last inference in seconds
+   * @param now current time
+   */
+  void update(uint64_t completedsequence, double inferencetime, Clock::time_point now);
+
+  /**
+   * Decides if the new frame should be passed to the detector.
+   *
+   * @param frameindex index of the frame in the video source, dropped frames included
+   * @param arrival time the frame was received
+   * @return true if the frame should be submitted
+   */
+  bool shouldSubmit(uint64_t frameindex, Clock::time_point arrival);
+
+  /**
+   * Records the frame passed to the detector.
+   *
+   * @param sequence sequence number returned by the detector
+   * @param frameindex index of the frame in the video source
+   * @param arrival time the frame was received
+   */
+  void submitted(uint64_t sequence, uint64_t frameindex, Clock::time_point arrival);
+
+  /**
+   * Returns how far the detections lag behind the displayed frame.
+   *
+   * @param detectionsequence sequence number of the frame the displayed detections were computed on
+   * @param frameindex index of the displayed frame
+   * @param now current time
+   * @return difference in frames and age of the detected frame in milliseconds, zero if the frame is not known
+   */
+  Staleness staleness(uint64_t detectionsequence, uint64_t frameindex, Clock::time_point now) const;
+
+  /**
+   * Returns the time the submitted frame was received.
+   *
+   * @param sequence sequence number returned by the detector
+   * @param arrival receives the time the frame was received
+   * @return false if the frame is not among recently submitted frames
+   */
+  bool arrivalTime(uint64_t sequence, Clock::time_point& arrival) const;
+
+  /**
+   * Returns the number of source frames per inference used in EveryNth mode.
+   *
+   * @return at least 1
+   */
+  int skipInterval() const;
+
+  /**
+   * Returns the predicted latency of a frame submitted now.
+   *
+   * @param now current time
+   * @return latency in seconds
+   */
+  double predictedLatency(Clock::time_point now) const;
+
+  /**
+   * Returns the number of frames not passed to the detector.
+   *
+   * @return skipped frames since creation
+   */
+  uint64_t skippedFrames() const;
+
+  SkipMode mode;
+  double targetlatency; ///< maximum predicted latency of a submitted frame in seconds, 0 disables the limit
+
+private:
+  struct Submission
+  {
+    uint64_t sequence = 0;
+    uint64_t frameindex = 0;
+    Clock::time_point arrival;
+  };
+
+  bool isIdle() const;
+
+  static constexpr double smoothing = 0.1;
+  static constexpr int historysize = 16;
+
+  double inferenceestimate = 0.0;
+  double frameinterval = 0.0;
+  uint64_t lastframeindex = 0;
+  Clock::time_point lastarrival;
+  bool hasarrival = false;
+
+  uint64_t lastsubmittedsequence = 0;
+  uint64_t lastsubmittedindex = 0;
+  uint64_t completedsequence = 0;
+  // estimated start of the inference in progress, the pending frame starts once it ends
+  Clock::time_point inferencestart;
+  bool pending = false;
+  uint64_t skipped = 0;
+
+  std::array<Submission, historysize> history {};
+};
+
+#endif
@@ -0,0 +1,212 @@
+#include "MemoryUsage.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include <unistd.h>
+
+#ifdef COUNT_ALLOCATIONS
+namespace
+{
+thread_local uint64_t allocations = 0;
+
+/**
+ * Allocates like the default operator new: calls the new handler until the allocation succeeds
+ * and throws std::bad_alloc if no handler is installed
+ */
+void* countedAllocation(std::size_t size)
+{
+  allocations++;
+  if (size == 0)
+  {
+    size = 1;
+  }
+  void* pointer;
+  while (!(pointer = std::malloc(size)))
+  {
+    std::new_handler handler = std::get_new_handler();
+    if (!handler)
+    {
+      throw std::bad_alloc();
+    }
+    handler();
+  }
+  return pointer;
+}
+
+void* countedAlignedAllocation(std::size_t size, std::align_val_t alignment)
+{
+  allocations++;
+  std::size_t align = static_cast<std::size_t>(alignment);
+  // aligned_alloc requires the size to be a multiple of the alignment
+  size = std::max<std::size_t>((size + align - 1) / align * align, align);
+  void* pointer;
+  while (!(pointer = std::aligned_alloc(align, size)))
+  {
+    std::new_handler handler = std::get_new_handler();
+    if (!handler)
+    {
+      throw std::bad_alloc();
+    }
+    handler();
+  }
+  return pointer;
+}
+}
+#endif
+
+size_t residentMemory()
+{
+  FILE* statm = fopen("/proc/self/statm", "r");
+  if (!statm)
+  {
+    return 0;
+  }
+  unsigned long long totalpages = 0;
+  unsigned long long residentpages = 0;
+  int read = fscanf(statm, "%llu %llu", &totalpages, &residentpages);
+  fclose(statm);
+  if (read != 2)
+  {
+    return 0;
+  }
+  return residentpages * sysconf(_SC_PAGESIZE);
+}
+
+#ifdef COUNT_ALLOCATIONS
+uint64_t threadAllocations()
+{
+  return allocations;
+}
+
+bool allocationsCounted()
+{
+  return true;
+}
+
+void* operator new(std::size_t size)
+{
+  return countedAllocation(size);
+}
+
+void* operator new[](std::size_t size)
+{
+  return countedAllocation(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+  try
+  {
+    return countedAllocation(size);
+  }
+  catch (...)
+  {
+    return nullptr;
+  }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+  return operator new(size, std::nothrow);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+  return countedAlignedAllocation(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+  return countedAlignedAllocation(size, alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+  try
+  {
+    return countedAlignedAllocation(size, alignment);
+  }
+  catch (...)
+  {
+    return nullptr;
+  }
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+  return operator new(size, alignment, std::nothrow);
+}
+
+void operator delete(void* pointer) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept
+{
+  std::free(pointer);
+}
+#else
+uint64_t threadAllocations()
+{
+  return 0;
+}
+
+bool allocationsCounted()
+{
+  return false;
+}
+#endif
@@ -0,0 +1,32 @@
+#ifndef MEMORYUSAGE_H
+#define MEMORYUSAGE_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Returns the resident set size of the process, read from /proc/self/statm.
+ *
+ * @return resident memory in bytes, 0 if it cannot be read
+ */
+size_t residentMemory();
+
+/**
+ * Returns the number of heap allocations made with operator new by the calling thread.
+ *
+ * Builds with COUNT_ALLOCATIONS defined replace global operator new to count allocations,
+ * differences between two calls tell how many allocations the code in between made.
+ * Allocations made by C libraries with malloc are not counted.
+ *
+ * @return allocations since the thread started, always 0 without COUNT_ALLOCATIONS
+ */
+uint64_t threadAllocations();
+
+/**
+ * Tells if global operator new is replaced to count allocations.
+ *
+ * @return true in builds with COUNT_ALLOCATIONS defined
+ */
+bool allocationsCounted();
+
+#endif
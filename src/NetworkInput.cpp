@@ -0,0 +1,519 @@
+#include "NetworkInput.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PREPROCESSING_AVX2 __attribute__((target("avx2,fma")))
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/**
+ * Precomputed source positions and bilinear weights for every output column and row
+ */
+struct ResizeTables
+{
+  cv::Size picturesize {0, 0};
+  PixelFormat format = PixelFormat::BGR;
+  bool letterbox = false;
+
+  InputTransform transform;
+  cv::Rect placement;
+
+  // byte offsets of the left and right neighbour in a BGR or Y row
+  std::vector<int> x0, x1;
+  std::vector<float> fx;
+  // indices of the upper and lower neighbouring rows
+  std::vector<int> y0, y1;
+  std::vector<float> fy;
+
+  // the same for the chroma planes of YUV frames
+  std::vector<int> cx0, cx1;
+  std::vector<float> cfx;
+  std::vector<int> cy0, cy1;
+  std::vector<float> cfy;
+
+  // number of leading columns for which 4-byte loads at all offsets stay inside the row
+  int vectorcolumns = 0;
+};
+
+/**
+ * Pointers to the source rows blended into one output row
+ */
+struct SourceRows
+{
+  const uchar* top = nullptr;
+  const uchar* bottom = nullptr;
+  const uchar* utop = nullptr;
+  const uchar* ubottom = nullptr;
+  const uchar* vtop = nullptr;
+  const uchar* vbottom = nullptr;
+  float fy = 0.0f;
+  float cfy = 0.0f;
+};
+
+namespace
+{
+
+constexpr float normalization = 1.0f / 255.0f;
+// BT.601 limited range YUV to RGB, with normalization folded in
+constexpr float lumascale = 1.164f / 255.0f;
+constexpr float vtored = 1.596f / 255.0f;
+constexpr float utogreen = -0.391f / 255.0f;
+constexpr float vtogreen = -0.813f / 255.0f;
+constexpr float utoblue = 2.018f / 255.0f;
+
+void linearAxis(int sourcelength, int targetlength, int stride,
+    std::vector<int>& first, std::vector<int>& second, std::vector<float>& weight)
+{
+  first.resize(targetlength);
+  second.resize(targetlength);
+  weight.resize(targetlength);
+  const float scale = static_cast<float>(sourcelength) / targetlength;
+  for (int i = 0; i < targetlength; i++)
+  {
+    float position = std::max((i + 0.5f) * scale - 0.5f, 0.0f);
+    int index = std::min(static_cast<int>(position), sourcelength - 1);
+    first[i] = index * stride;
+    second[i] = std::min(index + 1, sourcelength - 1) * stride;
+    weight[i] = std::min(position - index, 1.0f);
+  }
+}
+
+SourceRows sourceRows(const cv::Mat& source, PixelFormat format, const ResizeTables& tables, int row)
+{
+  SourceRows rows;
+  rows.top = source.ptr<uchar>(tables.y0[row]);
+  rows.bottom = source.ptr<uchar>(tables.y1[row]);
+  rows.fy = tables.fy[row];
+  if (format == PixelFormat::BGR)
+  {
+    return rows;
+  }
+
+  const int width = tables.picturesize.width;
+  const int height = tables.picturesize.height;
+  if (format == PixelFormat::NV12)
+  {
+    rows.utop = source.ptr<uchar>(height + tables.cy0[row]);
+    rows.ubottom = source.ptr<uchar>(height + tables.cy1[row]);
+    rows.vtop = rows.utop + 1;
+    rows.vbottom = rows.ubottom + 1;
+  }
+  else
+  {
+    const int chromastride = width / 2;
+    const uchar* uplane = source.ptr<uchar>(0) + width * height;
+    const uchar* vplane = uplane + chromastride * (height / 2);
+    rows.utop = uplane + tables.cy0[row] * chromastride;
+    rows.ubottom = uplane + tables.cy1[row] * chromastride;
+    rows.vtop = vplane + tables.cy0[row] * chromastride;
+    rows.vbottom = vplane + tables.cy1[row] * chromastride;
+  }
+  rows.cfy = tables.cfy[row];
+  return rows;
+}
+
+inline float blend(float a, float b, float t)
+{
+  return a + (b - a) * t;
+}
+
+inline float bilinear(const uchar* top, const uchar* bottom, int first, int second, float fx, float fy)
+{
+  return blend(blend(top[first], top[second], fx), blend(bottom[first], bottom[second], fx), fy);
+}
+
+void bgrRowScalar(const SourceRows& rows, const ResizeTables& t, int begin, int end, float* red, float* green, float* blue)
+{
+  for (int i = begin; i < end; i++)
+  {
+    blue[i] = bilinear(rows.top, rows.bottom, t.x0[i], t.x1[i], t.fx[i], rows.fy) * normalization;
+    green[i] = bilinear(rows.top + 1, rows.bottom + 1, t.x0[i], t.x1[i], t.fx[i], rows.fy) * normalization;
+    red[i] = bilinear(rows.top + 2, rows.bottom + 2, t.x0[i], t.x1[i], t.fx[i], rows.fy) * normalization;
+  }
+}
+
+void yuvRowScalar(const SourceRows& rows, const ResizeTables& t, int begin, int end, float* red, float* green, float* blue)
+{
+  for (int i = begin; i < end; i++)
+  {
+    float luma = (bilinear(rows.top, rows.bottom, t.x0[i], t.x1[i], t.fx[i], rows.fy) - 16.0f) * lumascale;
+    float u = bilinear(rows.utop, rows.ubottom, t.cx0[i], t.cx1[i], t.cfx[i], rows.cfy) - 128.0f;
+    float v = bilinear(rows.vtop, rows.vbottom, t.cx0[i], t.cx1[i], t.cfx[i], rows.cfy) - 128.0f;
+    red[i] = std::clamp(luma + vtored * v, 0.0f, 1.0f);
+    green[i] = std::clamp(luma + utogreen * u + vtogreen * v, 0.0f, 1.0f);
+    blue[i] = std::clamp(luma + utoblue * u, 0.0f, 1.0f);
+  }
+}
+
+void preprocessScalar(const cv::Mat& source, PixelFormat format, const ResizeTables& tables, cv::Size networksize, float* destination)
+{
+  const int planesize = networksize.area();
+  for (int row = 0; row < tables.placement.height; row++)
+  {
+    SourceRows rows = sourceRows(source, format, tables, row);
+    float* red = destination + (tables.placement.y + row) * networksize.width + tables.placement.x;
+    float* green = red + planesize;
+    float* blue = green + planesize;
+    if (format == PixelFormat::BGR)
+    {
+      bgrRowScalar(rows, tables, 0, tables.placement.width, red, green, blue);
+    }
+    else
+    {
+      yuvRowScalar(rows, tables, 0, tables.placement.width, red, green, blue);
+    }
+  }
+}
+
+#ifdef PREPROCESSING_AVX2
+
+template <int shift>
+PREPROCESSING_AVX2 inline __m256 byteLane(__m256i pixels)
+{
+  return _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(pixels, shift), _mm256_set1_epi32(0xFF)));
+}
+
+template <int shift>
+PREPROCESSING_AVX2 inline __m256 bilinearAvx2(__m256i a, __m256i b, __m256i c, __m256i d, __m256 fx, __m256 fy)
+{
+  __m256 top = _mm256_fmadd_ps(fx, _mm256_sub_ps(byteLane<shift>(b), byteLane<shift>(a)), byteLane<shift>(a));
+  __m256 bottom = _mm256_fmadd_ps(fx, _mm256_sub_ps(byteLane<shift>(d), byteLane<shift>(c)), byteLane<shift>(c));
+  return _mm256_fmadd_ps(fy, _mm256_sub_ps(bottom, top), top);
+}
+
+PREPROCESSING_AVX2 inline __m256 sampleAvx2(const uchar* top, const uchar* bottom, const int* first, const int* second, __m256 fx, __m256 fy)
+{
+  __m256i left = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+  __m256i right = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(second));
+  const int* topwords = reinterpret_cast<const int*>(top);
+  const int* bottomwords = reinterpret_cast<const int*>(bottom);
+  return bilinearAvx2<0>(
+      _mm256_i32gather_epi32(topwords, left, 1),
+      _mm256_i32gather_epi32(topwords, right, 1),
+      _mm256_i32gather_epi32(bottomwords, left, 1),
+      _mm256_i32gather_epi32(bottomwords, right, 1),
+      fx, fy);
+}
+
+PREPROCESSING_AVX2 int bgrRowAvx2(const SourceRows& rows, const ResizeTables& t, float* red, float* green, float* blue)
+{
+  const __m256 fy = _mm256_set1_ps(rows.fy);
+  const __m256 scale = _mm256_set1_ps(normalization);
+  const int* topwords = reinterpret_cast<const int*>(rows.top);
+  const int* bottomwords = reinterpret_cast<const int*>(rows.bottom);
+  int i = 0;
+  for (; i + 8 <= t.vectorcolumns; i += 8)
+  {
+    __m256i left = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(t.x0.data() + i));
+    __m256i right = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(t.x1.data() + i));
+    __m256 fx = _mm256_loadu_ps(t.fx.data() + i);
+    __m256i a = _mm256_i32gather_epi32(topwords, left, 1);
+    __m256i b = _mm256_i32gather_epi32(topwords, right, 1);
+    __m256i c = _mm256_i32gather_epi32(bottomwords, left, 1);
+    __m256i d = _mm256_i32gather_epi32(bottomwords, right, 1);
+    _mm256_storeu_ps(blue + i, _mm256_mul_ps(bilinearAvx2<0>(a, b, c, d, fx, fy), scale));
+    _mm256_storeu_ps(green + i, _mm256_mul_ps(bilinearAvx2<8>(a, b, c, d, fx, fy), scale));
+    _mm256_storeu_ps(red + i, _mm256_mul_ps(bilinearAvx2<16>(a, b, c, d, fx, fy), scale));
+  }
+  return i;
+}
+
+PREPROCESSING_AVX2 int yuvRowAvx2(const SourceRows& rows, const ResizeTables& t, float* red, float* green, float* blue)
+{
+  const __m256 fy = _mm256_set1_ps(rows.fy);
+  const __m256 cfy = _mm256_set1_ps(rows.cfy);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.0f);
+  int i = 0;
+  for (; i + 8 <= t.vectorcolumns; i += 8)
+  {
+    __m256 fx = _mm256_loadu_ps(t.fx.data() + i);
+    __m256 cfx = _mm256_loadu_ps(t.cfx.data() + i);
+    __m256 y = sampleAvx2(rows.top, rows.bottom, t.x0.data() + i, t.x1.data() + i, fx, fy);
+    __m256 u = sampleAvx2(rows.utop, rows.ubottom, t.cx0.data() + i, t.cx1.data() + i, cfx, cfy);
+    __m256 v = sampleAvx2(rows.vtop, rows.vbottom, t.cx0.data() + i, t.cx1.data() + i, cfx, cfy);
+
+    __m256 luma = _mm256_mul_ps(_mm256_sub_ps(y, _mm256_set1_ps(16.0f)), _mm256_set1_ps(lumascale));
+    u = _mm256_sub_ps(u, _mm256_set1_ps(128.0f));
+    v = _mm256_sub_ps(v, _mm256_set1_ps(128.0f));
+    __m256 r = _mm256_fmadd_ps(v, _mm256_set1_ps(vtored), luma);
+    __m256 g = _mm256_fmadd_ps(v, _mm256_set1_ps(vtogreen), _mm256_fmadd_ps(u, _mm256_set1_ps(utogreen), luma));
+    __m256 b = _mm256_fmadd_ps(u, _mm256_set1_ps(utoblue), luma);
+    _mm256_storeu_ps(red + i, _mm256_min_ps(_mm256_max_ps(r, zero), one));
+    _mm256_storeu_ps(green + i, _mm256_min_ps(_mm256_max_ps(g, zero), one));
+    _mm256_storeu_ps(blue + i, _mm256_min_ps(_mm256_max_ps(b, zero), one));
+  }
+  return i;
+}
+
+PREPROCESSING_AVX2 void preprocessAvx2(const cv::Mat& source, PixelFormat format, const ResizeTables& tables, cv::Size networksize, float* destination)
+{
+  const int planesize = networksize.area();
+  for (int row = 0; row < tables.placement.height; row++)
+  {
+    SourceRows rows = sourceRows(source, format, tables, row);
+    float* red = destination + (tables.placement.y + row) * networksize.width + tables.placement.x;
+    float* green = red + planesize;
+    float* blue = green + planesize;
+    if (format == PixelFormat::BGR)
+    {
+      int done = bgrRowAvx2(rows, tables, red, green, blue);
+      bgrRowScalar(rows, tables, done, tables.placement.width, red, green, blue);
+    }
+    else
+    {
+      int done = yuvRowAvx2(rows, tables, red, green, blue);
+      yuvRowScalar(rows, tables, done, tables.placement.width, red, green, blue);
+    }
+  }
+}
+
+#elif defined(__ARM_NEON)
+
+inline float32x4_t bilinearNeon(const float (&corners)[4][4], float32x4_t fx, float32x4_t fy)
+{
+  float32x4_t a = vld1q_f32(corners[0]);
+  float32x4_t b = vld1q_f32(corners[1]);
+  float32x4_t c = vld1q_f32(corners[2]);
+  float32x4_t d = vld1q_f32(corners[3]);
+  float32x4_t top = vmlaq_f32(a, fx, vsubq_f32(b, a));
+  float32x4_t bottom = vmlaq_f32(c, fx, vsubq_f32(d, c));
+  return vmlaq_f32(top, fy, vsubq_f32(bottom, top));
+}
+
+int bgrRowNeon(const SourceRows& rows, const ResizeTables& t, float* red, float* green, float* blue)
+{
+  const float32x4_t fy = vdupq_n_f32(rows.fy);
+  const float32x4_t scale = vdupq_n_f32(normalization);
+  float corners[3][4][4];
+  int i = 0;
+  for (; i + 4 <= t.placement.width; i += 4)
+  {
+    for (int lane = 0; lane < 4; lane++)
+    {
+      const uchar* a = rows.top + t.x0[i + lane];
+      const uchar* b = rows.top + t.x1[i + lane];
+      const uchar* c = rows.bottom + t.x0[i + lane];
+      const uchar* d = rows.bottom + t.x1[i + lane];
+      for (int channel = 0; channel < 3; channel++)
+      {
+        corners[channel][0][lane] = a[channel];
+        corners[channel][1][lane] = b[channel];
+        corners[channel][2][lane] = c[channel];
+        corners[channel][3][lane] = d[channel];
+      }
+    }
+    float32x4_t fx = vld1q_f32(t.fx.data() + i);
+    vst1q_f32(blue + i, vmulq_f32(bilinearNeon(corners[0], fx, fy), scale));
+    vst1q_f32(green + i, vmulq_f32(bilinearNeon(corners[1], fx, fy), scale));
+    vst1q_f32(red + i, vmulq_f32(bilinearNeon(corners[2], fx, fy), scale));
+  }
+  return i;
+}
+
+void preprocessNeon(const cv::Mat& source, PixelFormat format, const ResizeTables& tables, cv::Size networksize, float* destination)
+{
+  if (format != PixelFormat::BGR)
+  {
+    preprocessScalar(source, format, tables, networksize, destination);
+    return;
+  }
+  const int planesize = networksize.area();
+  for (int row = 0; row < tables.placement.height; row++)
+  {
+    SourceRows rows = sourceRows(source, format, tables, row);
+    float* red = destination + (tables.placement.y + row) * networksize.width + tables.placement.x;
+    float* green = red + planesize;
+    float* blue = green + planesize;
+    int done = bgrRowNeon(rows, tables, red, green, blue);
+    bgrRowScalar(rows, tables, done, tables.placement.width, red, green, blue);
+  }
+}
+
+#endif
+
+}
+
+FusedPreprocessor::FusedPreprocessor(cv::Size networksize, bool allowsimd) :
+  networksize(networksize),
+  kernel(preprocessScalar)
+{
+  if (!allowsimd)
+  {
+    return;
+  }
+#ifdef PREPROCESSING_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+  {
+    kernel = preprocessAvx2;
+    kernelname = "avx2";
+  }
+#elif defined(__ARM_NEON)
+  kernel = preprocessNeon;
+  kernelname = "neon";
+#endif
+}
+
+FusedPreprocessor::~FusedPreprocessor() = default;
+
+const char* FusedPreprocessor::kernelName() const
+{
+  return kernelname;
+}
+
+const ResizeTables& FusedPreprocessor::lookupTables(cv::Size picturesize, PixelFormat format, bool letterbox)
+{
+  auto cached = std::find_if(tables.begin(), tables.end(), [&](const std::unique_ptr<ResizeTables>& entry)
+  {
+    return entry->picturesize == picturesize && entry->format == format && entry->letterbox == letterbox;
+  });
+  if (cached != tables.end())
+  {
+    // most recently used tables are kept at the front, so the least recently used one is evicted
+    std::rotate(tables.begin(), cached, cached + 1);
+    return *tables.front();
+  }
+
+  if (tables.size() >= maxcachedtables)
+  {
+    tables.pop_back();
+  }
+  tables.insert(tables.begin(), std::make_unique<ResizeTables>());
+  ResizeTables& t = *tables.front();
+  t.picturesize = picturesize;
+  t.format = format;
+  t.letterbox = letterbox;
+
+  t.transform = computeInputTransform(picturesize, networksize, letterbox);
+  t.placement = cv::Rect(0, 0, networksize.width, networksize.height);
+  if (letterbox)
+  {
+    t.placement = cv::Rect(
+        t.transform.offsetx,
+        t.transform.offsety,
+        static_cast<int>(picturesize.width * t.transform.scalex),
+        static_cast<int>(picturesize.height * t.transform.scaley));
+  }
+
+  const int stride = format == PixelFormat::BGR ? 3 : 1;
+  linearAxis(picturesize.width, t.placement.width, stride, t.x0, t.x1, t.fx);
+  linearAxis(picturesize.height, t.placement.height, 1, t.y0, t.y1, t.fy);
+
+  const int rowbytes = picturesize.width * stride;
+  int chromarowbytes = 0;
+  int chromaoverread = 0;
+  if (format != PixelFormat::BGR)
+  {
+    const int chromastride = format == PixelFormat::NV12 ? 2 : 1;
+    linearAxis(picturesize.width / 2, t.placement.width, chromastride, t.cx0, t.cx1, t.cfx);
+    linearAxis(picturesize.height / 2, t.placement.height, 1, t.cy0, t.cy1, t.cfy);
+    chromarowbytes = format == PixelFormat::NV12 ? picturesize.width : picturesize.width / 2;
+    // V samples of NV12 are read one byte after U samples
+    chromaoverread = format == PixelFormat::NV12 ? 1 : 0;
+  }
+
+  t.vectorcolumns = 0;
+  while (t.vectorcolumns < t.placement.width
+      && t.x1[t.vectorcolumns] + 4 <= rowbytes
+      && (format == PixelFormat::BGR || t.cx1[t.vectorcolumns] + 4 + chromaoverread <= chromarowbytes))
+  {
+    t.vectorcolumns++;
+  }
+  return t;
+}
+
+void FusedPreprocessor::preparePadding(const cv::Rect& placement, float* destination)
+{
+  const cv::Rect whole(0, 0, networksize.width, networksize.height);
+  if (destination == paddeddestination && placement == paddedplacement)
+  {
+    return;
+  }
+  if (destination != paddeddestination)
+  {
+    // contents of a new destination are unknown, so everything outside the placement is padded
+    if (placement != whole)
+    {
+      std::fill(destination, destination + 3 * networksize.area(), 0.5f);
+    }
+  }
+  else
+  {
+    // padding is never overwritten by the kernel, so only pixels of the previous placement are cleared
+    for (int plane = 0; plane < 3; plane++)
+    {
+      for (int row = paddedplacement.y; row < paddedplacement.y + paddedplacement.height; row++)
+      {
+        float* start = destination + (plane * networksize.height + row) * networksize.width + paddedplacement.x;
+        std::fill(start, start + paddedplacement.width, 0.5f);
+      }
+    }
+  }
+  paddeddestination = destination;
+  paddedplacement = placement;
+}
+
+InputTransform FusedPreprocessor::run(const cv::Mat& source, PixelFormat format, bool letterbox, float* destination)
+{
+  if (format == PixelFormat::BGR && source.type() != CV_8UC3)
+  {
+    throw std::runtime_error("Expected 8-bit 3-channel BGR frame");
+  }
+  if (format != PixelFormat::BGR && (source.type() != CV_8UC1 || source.rows % 3 != 0 || source.cols % 2 != 0))
+  {
+    throw std::runtime_error("Expected 8-bit single-channel YUV frame with even dimensions");
+  }
+  if (format == PixelFormat::I420 && !source.isContinuous())
+  {
+    throw std::runtime_error("I420 frames have to be stored in continuous memory");
+  }
+
+  const ResizeTables& resizetables = lookupTables(pictureSize(source, format), format, letterbox);
+  preparePadding(resizetables.placement, destination);
+  kernel(source, format, resizetables, networksize, destination);
+  return resizetables.transform;
+}
+
+NetworkInput::NetworkInput(cv::Size networksize, int batchsize) :
+  size(networksize),
+  data(3 * networksize.area() * std::max(batchsize, 1))
+{
+  for (int slot = 0; slot < std::max(batchsize, 1); slot++)
+  {
+    preprocessors.push_back(std::make_unique<FusedPreprocessor>(networksize));
+  }
+}
+
+InputTransform NetworkInput::fill(const cv::Mat& source, PixelFormat format, bool letterbox, int slot)
+{
+  if (slot < 0 || slot >= batchSize())
+  {
+    throw std::runtime_error("Network input slot out of range");
+  }
+  return preprocessors[slot]->run(source, format, letterbox, data.data() + 3 * size.area() * slot);
+}
+
+const char* NetworkInput::kernelName() const
+{
+  return preprocessors.front()->kernelName();
+}
+
+int NetworkInput::batchSize() const
+{
+  return static_cast<int>(preprocessors.size());
+}
+
+image_t NetworkInput::image()
+{
+  image_t networkimage;
+  networkimage.w = size.width;
+  networkimage.h = size.height;
+  networkimage.c = 3;
+  networkimage.data = data.data();
+  return networkimage;
+}
@@ -0,0 +1,123 @@
+#ifndef NETWORKINPUT_H
+#define NETWORKINPUT_H
+
+#include <memory>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "Preprocessing.hpp"
+
+struct ResizeTables;
+
+/**
+ * Fused preprocessing kernel: bilinear resize, colour conversion to RGB and normalization
+ * from a decoded frame to planar float network input in a single pass over the output.
+ *
+ * The AVX2 or NEON variant is selected at runtime when the CPU supports it,
+ * otherwise the scalar variant is used.
+ */
+class FusedPreprocessor
+{
+public:
+  /**
+   * Selects the kernel for the current CPU
+   * @param networksize - size of the network input
+   * @param allowsimd - if false, the scalar kernel is always used
+   */
+  FusedPreprocessor(cv::Size networksize, bool allowsimd = true);
+  ~FusedPreprocessor();
+
+  /**
+   * Writes the frame into the destination as normalized planar RGB floats.
+   *
+   * Resize tables are cached for the last few frame sizes, so alternating crops of different
+   * sizes do not rebuild them. Letterbox padding is written only when the destination or
+   * the placement of the picture in it changes.
+   *
+   * @param source - decoded frame
+   * @param format - pixel layout of the source frame
+   * @param letterbox - if true, aspect ratio is preserved and the rest of the input is padded with gray
+   * @param destination - buffer for 3 * networksize.area() floats
+   * @return transform from the network input back to the source frame
+   */
+  InputTransform run(const cv::Mat& source, PixelFormat format, bool letterbox, float* destination);
+
+  /**
+   * Returns the name of the selected kernel.
+   *
+   * @return "avx2", "neon" or "scalar"
+   */
+  const char* kernelName() const;
+
+private:
+  const ResizeTables& lookupTables(cv::Size picturesize, PixelFormat format, bool letterbox);
+  void preparePadding(const cv::Rect& placement, float* destination);
+
+  // enough for the region crops and edge tiles that share a batch slot
+  static constexpr size_t maxcachedtables = 8;
+
+  cv::Size networksize;
+  // most recently used first
+  std::vector<std::unique_ptr<ResizeTables>> tables;
+  // destination and picture placement the padding was last written for
+  float* paddeddestination = nullptr;
+  cv::Rect paddedplacement;
+  const char* kernelname = "scalar";
+  void (*kernel)(const cv::Mat&, PixelFormat, const ResizeTables&, cv::Size, float*);
+};
+
+/**
+ * Network input kept in darknet's planar RGB float layout, allocated once for the network size.
+ *
+ * For batched networks the buffer holds batchsize consecutive images, one per slot.
+ */
+class NetworkInput
+{
+public:
+  /**
+   * Allocates buffers for the network input
+   * @param networksize - size of the network input, as reported by get_net_width/height
+   * @param batchsize - number of images in the buffer
+   */
+  NetworkInput(cv::Size networksize, int batchsize = 1);
+
+  /**
+   * Resizes the frame to the network size and writes it as normalized planar RGB floats
+   * @param source - decoded frame
+   * @param format - pixel layout of the source frame
+   * @param letterbox - if true, aspect ratio is preserved and the rest of the input is padded with gray
+   * @param slot - index of the image in the batch
+   * @return transform from the network input back to the source frame
+   */
+  InputTransform fill(const cv::Mat& source, PixelFormat format, bool letterbox, int slot = 0);
+
+  /**
+   * Returns darknet image pointing to the persistent buffer, valid as long as this object lives.
+   * For batched input, data holds all slots one after another.
+   * @return network-sized image
+   */
+  image_t image();
+
+  /**
+   * Returns the number of images in the buffer.
+   *
+   * @return batch size given to the constructor
+   */
+  int batchSize() const;
+
+  /**
+   * Returns the name of the preprocessing kernel selected for the current CPU.
+   *
+   * @return "avx2", "neon" or "scalar"
+   */
+  const char* kernelName() const;
+
+private:
+  cv::Size size;
+  std::vector<float> data;
+  // one preprocessor per slot keeps resize tables and padding of every slot cached
+  std::vector<std::unique_ptr<FusedPreprocessor>> preprocessors;
+};
+
+#endif
@@ -0,0 +1,246 @@
+#include "NonMaximumSuppression.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NMS_AVX2 __attribute__((target("avx2")))
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define NMS_NEON
+#endif
+
+namespace
+{
+
+// keeps the overlap of empty boxes at zero instead of dividing by zero
+constexpr float minimumunion = 1e-6f;
+
+void iouScalar(const float* x1, const float* y1, const float* x2, const float* y2, const float* area,
+    size_t count, float bx1, float by1, float bx2, float by2, float barea, float* iou)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    float width = std::max(std::min(x2[i], bx2) - std::max(x1[i], bx1), 0.0f);
+    float height = std::max(std::min(y2[i], by2) - std::max(y1[i], by1), 0.0f);
+    float intersection = width * height;
+    iou[i] = intersection / std::max(area[i] + barea - intersection, minimumunion);
+  }
+}
+
+#ifdef NMS_AVX2
+
+NMS_AVX2 void iouAvx2(const float* x1, const float* y1, const float* x2, const float* y2, const float* area,
+    size_t count, float bx1, float by1, float bx2, float by2, float barea, float* iou)
+{
+  const __m256 boxx1 = _mm256_set1_ps(bx1);
+  const __m256 boxy1 = _mm256_set1_ps(by1);
+  const __m256 boxx2 = _mm256_set1_ps(bx2);
+  const __m256 boxy2 = _mm256_set1_ps(by2);
+  const __m256 boxarea = _mm256_set1_ps(barea);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 minunion = _mm256_set1_ps(minimumunion);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m256 width = _mm256_sub_ps(_mm256_min_ps(_mm256_loadu_ps(x2 + i), boxx2), _mm256_max_ps(_mm256_loadu_ps(x1 + i), boxx1));
+    __m256 height = _mm256_sub_ps(_mm256_min_ps(_mm256_loadu_ps(y2 + i), boxy2), _mm256_max_ps(_mm256_loadu_ps(y1 + i), boxy1));
+    __m256 intersection = _mm256_mul_ps(_mm256_max_ps(width, zero), _mm256_max_ps(height, zero));
+    __m256 areaunion = _mm256_sub_ps(_mm256_add_ps(_mm256_loadu_ps(area + i), boxarea), intersection);
+    _mm256_storeu_ps(iou + i, _mm256_div_ps(intersection, _mm256_max_ps(areaunion, minunion)));
+  }
+  iouScalar(x1 + i, y1 + i, x2 + i, y2 + i, area + i, count - i, bx1, by1, bx2, by2, barea, iou + i);
+}
+
+#elif defined(NMS_NEON)
+
+void iouNeon(const float* x1, const float* y1, const float* x2, const float* y2, const float* area,
+    size_t count, float bx1, float by1, float bx2, float by2, float barea, float* iou)
+{
+  const float32x4_t boxx1 = vdupq_n_f32(bx1);
+  const float32x4_t boxy1 = vdupq_n_f32(by1);
+  const float32x4_t boxx2 = vdupq_n_f32(bx2);
+  const float32x4_t boxy2 = vdupq_n_f32(by2);
+  const float32x4_t boxarea = vdupq_n_f32(barea);
+  const float32x4_t zero = vdupq_n_f32(0.0f);
+  const float32x4_t minunion = vdupq_n_f32(minimumunion);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    float32x4_t width = vsubq_f32(vminq_f32(vld1q_f32(x2 + i), boxx2), vmaxq_f32(vld1q_f32(x1 + i), boxx1));
+    float32x4_t height = vsubq_f32(vminq_f32(vld1q_f32(y2 + i), boxy2), vmaxq_f32(vld1q_f32(y1 + i), boxy1));
+    float32x4_t intersection = vmulq_f32(vmaxq_f32(width, zero), vmaxq_f32(height, zero));
+    float32x4_t areaunion = vsubq_f32(vaddq_f32(vld1q_f32(area + i), boxarea), intersection);
+    vst1q_f32(iou + i, vdivq_f32(intersection, vmaxq_f32(areaunion, minunion)));
+  }
+  iouScalar(x1 + i, y1 + i, x2 + i, y2 + i, area + i, count - i, bx1, by1, bx2, by2, barea, iou + i);
+}
+
+#endif
+
+}
+
+NonMaximumSuppression::NonMaximumSuppression(bool allowsimd) :
+  kernel(iouScalar)
+{
+  if (!allowsimd)
+  {
+    return;
+  }
+#ifdef NMS_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+  {
+    kernel = iouAvx2;
+    kernelname = "avx2";
+  }
+#elif defined(NMS_NEON)
+  kernel = iouNeon;
+  kernelname = "neon";
+#endif
+}
+
+const char* NonMaximumSuppression::kernelName() const
+{
+  return kernelname;
+}
+
+void NonMaximumSuppression::run(std::vector<bbox_t>& objects, const NmsSettings& settings)
+{
+  if (objects.size() < 2)
+  {
+    return;
+  }
+
+  order.resize(objects.size());
+  std::iota(order.begin(), order.end(), 0);
+  if (settings.classaware)
+  {
+    std::sort(order.begin(), order.end(), [&objects](size_t a, size_t b) {
+      return objects[a].obj_id != objects[b].obj_id ? objects[a].obj_id < objects[b].obj_id : objects[a].prob > objects[b].prob;
+    });
+  }
+  else
+  {
+    std::sort(order.begin(), order.end(), [&objects](size_t a, size_t b) { return objects[a].prob > objects[b].prob; });
+  }
+  sorted.clear();
+  for (size_t index : order)
+  {
+    sorted.push_back(objects[index]);
+  }
+  load(sorted);
+
+  // class-aware suppression runs separately on the range of every class
+  size_t first = 0;
+  while (first < sorted.size())
+  {
+    size_t last = first + 1;
+    while (last < sorted.size() && (!settings.classaware || sorted[last].obj_id == sorted[first].obj_id))
+    {
+      last++;
+    }
+    if (settings.soft)
+    {
+      suppressSoft(first, last, settings);
+    }
+    else
+    {
+      suppressHard(first, last, settings.iouthreshold);
+    }
+    first = last;
+  }
+
+  objects.clear();
+  for (size_t i = 0; i < sorted.size(); i++)
+  {
+    if (kept[i])
+    {
+      objects.push_back(sorted[i]);
+      objects.back().prob = scores[i];
+    }
+  }
+}
+
+void NonMaximumSuppression::load(const std::vector<bbox_t>& objects)
+{
+  size_t count = objects.size();
+  x1.resize(count);
+  y1.resize(count);
+  x2.resize(count);
+  y2.resize(count);
+  area.resize(count);
+  scores.resize(count);
+  overlaps.resize(count);
+  kept.assign(count, 1);
+  for (size_t i = 0; i < count; i++)
+  {
+    const bbox_t& object = objects[i];
+    x1[i] = static_cast<float>(object.x);
+    y1[i] = static_cast<float>(object.y);
+    x2[i] = static_cast<float>(object.x + object.w);
+    y2[i] = static_cast<float>(object.y + object.h);
+    area[i] = static_cast<float>(object.w) * static_cast<float>(object.h);
+    scores[i] = object.prob;
+  }
+}
+
+void NonMaximumSuppression::swapBoxes(size_t a, size_t b)
+{
+  std::swap(x1[a], x1[b]);
+  std::swap(y1[a], y1[b]);
+  std::swap(x2[a], x2[b]);
+  std::swap(y2[a], y2[b]);
+  std::swap(area[a], area[b]);
+  std::swap(scores[a], scores[b]);
+  std::swap(sorted[a], sorted[b]);
+}
+
+void NonMaximumSuppression::suppressHard(size_t first, size_t last, float threshold)
+{
+  for (size_t i = first; i < last; i++)
+  {
+    if (!kept[i])
+    {
+      continue;
+    }
+    size_t next = i + 1;
+    kernel(x1.data() + next, y1.data() + next, x2.data() + next, y2.data() + next, area.data() + next, last - next,
+        x1[i], y1[i], x2[i], y2[i], area[i], overlaps.data() + next);
+    for (size_t j = next; j < last; j++)
+    {
+      if (overlaps[j] > threshold)
+      {
+        kept[j] = 0;
+      }
+    }
+  }
+}
+
+void NonMaximumSuppression::suppressSoft(size_t first, size_t last, const NmsSettings& settings)
+{
+  for (size_t i = first; i < last; i++)
+  {
+    // decayed probabilities change the order, so the most probable remaining box is picked every time
+    size_t best = std::max_element(scores.begin() + i, scores.begin() + last) - scores.begin();
+    swapBoxes(i, best);
+    if (scores[i] < settings.minprobability)
+    {
+      std::fill(kept.begin() + i, kept.begin() + last, 0);
+      return;
+    }
+    size_t next = i + 1;
+    kernel(x1.data() + next, y1.data() + next, x2.data() + next, y2.data() + next, area.data() + next, last - next,
+        x1[i], y1[i], x2[i], y2[i], area[i], overlaps.data() + next);
+    // only boxes overlapping above the threshold are decayed, so the threshold still separates neighbours
+    for (size_t j = next; j < last; j++)
+    {
+      if (overlaps[j] > settings.iouthreshold)
+      {
+        scores[j] *= std::exp(-overlaps[j] * overlaps[j] / settings.sigma);
+      }
+    }
+  }
+}
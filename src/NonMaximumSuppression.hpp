@@ -0,0 +1,90 @@
+#ifndef NONMAXIMUMSUPPRESSION_H
+#define NONMAXIMUMSUPPRESSION_H
+
+#include <cstddef>
+#include <vector>
+
+#include "YoloDetector.hpp"
+
+/**
+ * Parameters of non-maximum suppression
+ */
+struct NmsSettings
+{
+  bool enabled = true;        ///< if false, darknet's own suppression is used instead
+  bool classaware = true;     ///< if true, only boxes of the same class suppress each other
+  bool soft = false;          ///< if true, overlapping boxes get lower probability instead of being removed
+  float iouthreshold = 0.4f;  ///< overlap above which a box is suppressed
+  float sigma = 0.5f;         ///< width of the Gaussian decay of Soft-NMS
+  float minprobability = 0.05f; ///< boxes decayed by Soft-NMS below this probability are removed
+
+  bool operator==(const NmsSettings& other) const
+  {
+    return enabled == other.enabled && classaware == other.classaware && soft == other.soft
+      && iouthreshold == other.iouthreshold && sigma == other.sigma && minprobability == other.minprobability;
+  }
+
+  bool operator!=(const NmsSettings& other) const
+  {
+    return !(*this == other);
+  }
+};
+
+/**
+ * Non-maximum suppression of detected boxes with a vectorised overlap kernel.
+ *
+ * Boxes are kept in structure-of-arrays buffers reused between calls, and the overlap of the kept box
+ * with all remaining candidates is computed 8 (AVX2) or 4 (NEON) boxes at a time.
+ * The kernel is selected at runtime when the CPU supports it, otherwise the scalar variant is used.
+ *
+ * Hard suppression visits boxes from the most probable one and removes the following boxes overlapping it
+ * above the threshold. Soft-NMS instead multiplies their probability by exp(-iou^2 / sigma) and repeatedly
+ * picks the most probable remaining box.
+ */
+class NonMaximumSuppression
+{
+public:
+  /**
+   * Selects the kernel for the current CPU
+   * @param allowsimd - if false, the scalar kernel is always used
+   */
+  NonMaximumSuppression(bool allowsimd = true);
+
+  /**
+   * Suppresses overlapping boxes in place.
+   *
+   * @param objects detected boxes, receives the kept boxes sorted by class if class-aware, then by probability
+   * @param settings suppression parameters, enabled is ignored
+   */
+  void run(std::vector<bbox_t>& objects, const NmsSettings& settings);
+
+  /**
+   * Returns the name of the selected kernel.
+   *
+   * @return "avx2", "neon" or "scalar"
+   */
+  const char* kernelName() const;
+
+  /**
+   * Computes the overlap of a box with consecutive boxes stored as corner and area arrays.
+   */
+  using IouKernel = void (*)(const float* x1, const float* y1, const float* x2, const float* y2, const float* area,
+      size_t count, float bx1, float by1, float bx2, float by2, float barea, float* iou);
+
+private:
+  void load(const std::vector<bbox_t>& objects);
+  void swapBoxes(size_t a, size_t b);
+  void suppressHard(size_t first, size_t last, float threshold);
+  void suppressSoft(size_t first, size_t last, const NmsSettings& settings);
+
+  IouKernel kernel;
+  const char* kernelname = "scalar";
+
+  std::vector<size_t> order;
+  std::vector<float> x1, y1, x2, y2, area, scores;
+  std::vector<float> overlaps;
+  std::vector<unsigned char> kept;
+  std::vector<bbox_t> sorted;
+};
+
+#endif
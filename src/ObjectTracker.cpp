@@ -0,0 +1,304 @@
+#include "ObjectTracker.hpp"
+
+#include <algorithm>
+
+namespace
+{
+// variances of the measured box and of the process noise per second
+constexpr float measurementnoise = 25.0f;
+constexpr float initialvelocityvariance = 10000.0f;
+constexpr float positionnoise = 10.0f;
+constexpr float velocitynoise = 10000.0f;
+
+cv::Rect2f toRect(const bbox_t& object)
+{
+  return cv::Rect2f(object.x, object.y, object.w, object.h);
+}
+
+float median(std::vector<float>& values)
+{
+  auto middle = values.begin() + values.size() / 2;
+  std::nth_element(values.begin(), middle, values.end());
+  return *middle;
+}
+}
+
+void ObjectTracker::update(const std::vector<bbox_t>& detections, Clock::time_point capturetime)
+{
+  for (Track& track : tracks)
+  {
+    predictTrack(track, capturetime);
+  }
+
+  // tracks refined with optical flow are already past the capture time, detections are moved forward
+  // by the flow measured since then, so that they are compared and applied at the state time of the track
+  candidates.clear();
+  for (size_t t = 0; t < tracks.size(); t++)
+  {
+    cv::Rect2f predicted = trackBox(tracks[t], capturetime);
+    cv::Point2f shift = flowSince(tracks[t], capturetime);
+    for (size_t d = 0; d < detections.size(); d++)
+    {
+      if (detections[d].obj_id != tracks[t].object.obj_id)
+      {
+        continue;
+      }
+      float overlap = intersectionOverUnion(predicted, toRect(detections[d]) + shift);
+      if (overlap >= matchthreshold)
+      {
+        candidates.emplace_back(overlap, t, d);
+      }
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(),
+      [](const auto& a, const auto& b) { return std::get<0>(a) > std::get<0>(b); });
+
+  trackmatched.assign(tracks.size(), false);
+  detectionmatched.assign(detections.size(), false);
+  for (const auto& [overlap, t, d] : candidates)
+  {
+    if (trackmatched[t] || detectionmatched[d])
+    {
+      continue;
+    }
+    trackmatched[t] = true;
+    detectionmatched[d] = true;
+    Track& track = tracks[t];
+    correctTrack(track, toRect(detections[d]) + flowSince(track, capturetime));
+    track.object = detections[d];
+    track.hits++;
+    track.misses = 0;
+  }
+
+  for (size_t t = 0; t < tracks.size(); t++)
+  {
+    if (!trackmatched[t])
+    {
+      tracks[t].misses++;
+    }
+  }
+  tracks.erase(std::remove_if(tracks.begin(), tracks.end(),
+      [](const Track& track) { return track.misses > maxmisses; }), tracks.end());
+
+  for (size_t d = 0; d < detections.size(); d++)
+  {
+    if (!detectionmatched[d])
+    {
+      createTrack(detections[d], capturetime);
+    }
+  }
+}
+
+void ObjectTracker::refine(const cv::Mat& frame, PixelFormat format, Clock::time_point time)
+{
+  cv::Mat gray;
+  if (format == PixelFormat::BGR)
+  {
+    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+  }
+  else
+  {
+    // the luma plane of NV12 and I420 frames is already a grayscale picture
+    gray = frame.rowRange(0, pictureSize(frame, format).height).clone();
+  }
+
+  if (!previousgray.empty() && previousgray.size() == gray.size() && time > previoustime && !tracks.empty())
+  {
+    std::vector<cv::Point2f> points;
+    std::vector<size_t> owners;
+    for (size_t t = 0; t < tracks.size(); t++)
+    {
+      cv::Rect2f box = trackBox(tracks[t], previoustime);
+      for (int gy = 0; gy < flowgrid; gy++)
+      {
+        for (int gx = 0; gx < flowgrid; gx++)
+        {
+          float x = box.x + box.width * (gx + 0.5f) / flowgrid;
+          float y = box.y + box.height * (gy + 0.5f) / flowgrid;
+          if (x >= 0.0f && y >= 0.0f && x < gray.cols && y < gray.rows)
+          {
+            points.emplace_back(x, y);
+            owners.push_back(t);
+          }
+        }
+      }
+    }
+
+    if (!points.empty())
+    {
+      std::vector<cv::Point2f> moved;
+      std::vector<uchar> status;
+      std::vector<float> errors;
+      cv::calcOpticalFlowPyrLK(previousgray, gray, points, moved, status, errors);
+
+      std::vector<std::vector<float>> shiftsx(tracks.size()), shiftsy(tracks.size());
+      for (size_t i = 0; i < points.size(); i++)
+      {
+        if (status[i])
+        {
+          shiftsx[owners[i]].push_back(moved[i].x - points[i].x);
+          shiftsy[owners[i]].push_back(moved[i].y - points[i].y);
+        }
+      }
+      for (size_t t = 0; t < tracks.size(); t++)
+      {
+        // a few tracked points are too easily dominated by background or noise
+        if (shiftsx[t].size() < 3)
+        {
+          continue;
+        }
+        Track& track = tracks[t];
+        cv::Point2f shift(median(shiftsx[t]), median(shiftsy[t]));
+        cv::Rect2f measured = trackBox(track, previoustime) + shift;
+        predictTrack(track, time);
+        correctTrack(track, measured);
+        track.flowsteps[track.nextflowstep] = FlowStep {previoustime, shift};
+        track.nextflowstep = (track.nextflowstep + 1) % flowhistory;
+        track.flowstepcount = std::min(track.flowstepcount + 1, flowhistory);
+      }
+    }
+  }
+  previousgray = gray;
+  previoustime = time;
+}
+
+std::vector<bbox_t> ObjectTracker::predict(Clock::time_point time) const
+{
+  std::vector<bbox_t> objects;
+  predict(time, objects);
+  return objects;
+}
+
+void ObjectTracker::predict(Clock::time_point time, std::vector<bbox_t>& objects) const
+{
+  objects.clear();
+  for (const Track& track : tracks)
+  {
+    if (!isDisplayed(track))
+    {
+      continue;
+    }
+    cv::Rect2f box = trackBox(track, time);
+    bbox_t object = track.object;
+    object.x = static_cast<unsigned int>(std::max(box.x, 0.0f));
+    object.y = static_cast<unsigned int>(std::max(box.y, 0.0f));
+    object.w = static_cast<unsigned int>(box.width);
+    object.h = static_cast<unsigned int>(box.height);
+    object.track_id = track.id;
+    objects.push_back(object);
+  }
+}
+
+void ObjectTracker::clear()
+{
+  tracks.clear();
+  previousgray.release();
+}
+
+size_t ObjectTracker::trackCount() const
+{
+  return tracks.size();
+}
+
+void ObjectTracker::createTrack(const bbox_t& detection, Clock::time_point time)
+{
+  tracks.emplace_back();
+  Track& track = tracks.back();
+  track.id = nextid++;
+  track.object = detection;
+  track.statetime = time;
+  track.hits = 1;
+
+  // state is box center, size and their velocities, measurement is box center and size
+  cv::KalmanFilter& filter = track.filter;
+  filter.init(8, 4, 0, CV_32F);
+  cv::setIdentity(filter.transitionMatrix);
+  cv::setIdentity(filter.measurementMatrix);
+  cv::setIdentity(filter.measurementNoiseCov, cv::Scalar(measurementnoise));
+  cv::setIdentity(filter.errorCovPost, cv::Scalar(measurementnoise));
+  for (int i = 4; i < 8; i++)
+  {
+    filter.errorCovPost.at<float>(i, i) = initialvelocityvariance;
+  }
+  cv::Rect2f box = toRect(detection);
+  filter.statePost.at<float>(0) = box.x + box.width / 2;
+  filter.statePost.at<float>(1) = box.y + box.height / 2;
+  filter.statePost.at<float>(2) = box.width;
+  filter.statePost.at<float>(3) = box.height;
+}
+
+void ObjectTracker::predictTrack(Track& track, Clock::time_point time)
+{
+  float dt = std::chrono::duration<float>(time - track.statetime).count();
+  if (dt <= 0.0f)
+  {
+    return;
+  }
+  cv::KalmanFilter& filter = track.filter;
+  cv::setIdentity(filter.processNoiseCov, cv::Scalar(0));
+  for (int i = 0; i < 4; i++)
+  {
+    filter.transitionMatrix.at<float>(i, i + 4) = dt;
+    filter.processNoiseCov.at<float>(i, i) = positionnoise * dt;
+    filter.processNoiseCov.at<float>(i + 4, i + 4) = velocitynoise * dt;
+  }
+  filter.predict();
+  track.statetime = time;
+}
+
+void ObjectTracker::correctTrack(Track& track, const cv::Rect2f& box)
+{
+  cv::Mat measurement(4, 1, CV_32F);
+  measurement.at<float>(0) = box.x + box.width / 2;
+  measurement.at<float>(1) = box.y + box.height / 2;
+  measurement.at<float>(2) = box.width;
+  measurement.at<float>(3) = box.height;
+  track.filter.correct(measurement);
+}
+
+cv::Point2f ObjectTracker::flowSince(const Track& track, Clock::time_point time)
+{
+  cv::Point2f shift(0.0f, 0.0f);
+  for (size_t i = 0; i < track.flowstepcount; i++)
+  {
+    if (track.flowsteps[i].start >= time)
+    {
+      shift += track.flowsteps[i].shift;
+    }
+  }
+  return shift;
+}
+
+cv::Rect2f ObjectTracker::trackBox(const Track& track, Clock::time_point time)
+{
+  double elapsed = std::chrono::duration<double>(time - track.statetime).count();
+  float dt = static_cast<float>(std::clamp(elapsed, 0.0, maxextrapolation));
+  const cv::Mat& state = track.filter.statePost;
+  float width = std::max(state.at<float>(2) + state.at<float>(6) * dt, 1.0f);
+  float height = std::max(state.at<float>(3) + state.at<float>(7) * dt, 1.0f);
+  return cv::Rect2f(
+      state.at<float>(0) + state.at<float>(4) * dt - width / 2,
+      state.at<float>(1) + state.at<float>(5) * dt - height / 2,
+      width,
+      height);
+}
+
+float ObjectTracker::intersectionOverUnion(const cv::Rect2f& a, const cv::Rect2f& b)
+{
+  float left = std::max(a.x, b.x);
+  float top = std::max(a.y, b.y);
+  float right = std::min(a.x + a.width, b.x + b.width);
+  float bottom = std::min(a.y + a.height, b.y + b.height);
+  if (right <= left || bottom <= top)
+  {
+    return 0.0f;
+  }
+  float intersection = (right - left) * (bottom - top);
+  return intersection / (a.width * a.height + b.width * b.height - intersection);
+}
+
+bool ObjectTracker::isDisplayed(const Track& track) const
+{
+  // new tracks are shown right away, confirmed tracks also coast through missed detections
+  return track.misses == 0 || track.hits >= minhits;
+}
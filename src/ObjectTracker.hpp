@@ -0,0 +1,152 @@
+#ifndef OBJECTTRACKER_H
+#define OBJECTTRACKER_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "YoloDetector.hpp"
+
+#include "Preprocessing.hpp"
+
+/**
+ * SORT-style tracker assigning persistent identifiers to detections and predicting
+ * their positions between inferences.
+ *
+ * Every track keeps a constant velocity Kalman filter over box center and size.
+ * Detections are associated with tracks of the same class greedily by decreasing IoU
+ * of the boxes predicted for the time the detected frame was captured.
+ * Optionally, boxes are refined on every displayed frame with sparse optical flow.
+ * Used only by the render thread.
+ */
+class ObjectTracker
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  /**
+   * Corrects tracks with new detections, creates tracks for unmatched detections
+   * and removes tracks that were not matched for too long.
+   *
+   * @param detections objects found on the frame, in source frame coordinates
+   * @param capturetime time the detected frame was captured
+   */
+  void update(const std::vector<bbox_t>& detections, Clock::time_point capturetime);
+
+  /**
+   * Corrects tracks with the median optical flow of points inside their boxes
+   * between the previously refined frame and this one.
+   *
+   * The flow applied to every track is remembered for a short time, so that update() can move detections
+   * of frames older than the last refined frame forward by the flow measured since their capture.
+   *
+   * @param frame displayed frame
+   * @param format pixel layout of the frame
+   * @param time time the frame was captured
+   */
+  void refine(const cv::Mat& frame, PixelFormat format, Clock::time_point time);
+
+  /**
+   * Returns boxes of displayed tracks extrapolated to the given time, with track_id set.
+   *
+   * @param time time of the displayed frame
+   * @return predicted boxes in source frame coordinates
+   */
+  std::vector<bbox_t> predict(Clock::time_point time) const;
+
+  /**
+   * Writes boxes of displayed tracks extrapolated to the given time, reusing the storage of the vector.
+   *
+   * @param time time of the displayed frame
+   * @param objects receives predicted boxes in source frame coordinates
+   */
+  void predict(Clock::time_point time, std::vector<bbox_t>& objects) const;
+
+  /**
+   * Removes all tracks.
+   */
+  void clear();
+
+  /**
+   * Returns the number of tracks, including tentative ones.
+   *
+   * @return number of tracks
+   */
+  size_t trackCount() const;
+
+private:
+  static constexpr size_t flowhistory = 32;
+
+  /**
+   * Median optical flow of a track between two refined frames
+   */
+  struct FlowStep
+  {
+    Clock::time_point start; ///< capture time of the earlier frame
+    cv::Point2f shift;
+  };
+
+  struct Track
+  {
+    uint32_t id = 0;
+    bbox_t object {};
+    cv::KalmanFilter filter;
+    Clock::time_point statetime;
+    int hits = 0;
+    int misses = 0;
+    // ring of the last flow steps applied to the filter, in no particular order
+    std::array<FlowStep, flowhistory> flowsteps;
+    size_t flowstepcount = 0;
+    size_t nextflowstep = 0;
+  };
+
+  /**
+   * Creates a track with the filter initialized to the detection at rest.
+   */
+  void createTrack(const bbox_t& detection, Clock::time_point time);
+
+  /**
+   * Advances the filter of the track to the given time.
+   */
+  static void predictTrack(Track& track, Clock::time_point time);
+
+  /**
+   * Corrects the filter of the track with the box measured at its current state time.
+   */
+  static void correctTrack(Track& track, const cv::Rect2f& box);
+
+  /**
+   * Returns the optical flow applied to the track for frames captured at or after the given time.
+   */
+  static cv::Point2f flowSince(const Track& track, Clock::time_point time);
+
+  /**
+   * Returns the box of the track extrapolated to the given time without changing the filter.
+   */
+  static cv::Rect2f trackBox(const Track& track, Clock::time_point time);
+
+  static float intersectionOverUnion(const cv::Rect2f& a, const cv::Rect2f& b);
+
+  bool isDisplayed(const Track& track) const;
+
+  static constexpr float matchthreshold = 0.3f;
+  static constexpr int minhits = 3;
+  static constexpr int maxmisses = 2;
+  static constexpr double maxextrapolation = 0.5;
+  static constexpr int flowgrid = 5;
+
+  std::vector<Track> tracks;
+  uint32_t nextid = 1;
+  // association buffers kept between updates to avoid allocations
+  std::vector<std::tuple<float, size_t, size_t>> candidates;
+  std::vector<bool> trackmatched;
+  std::vector<bool> detectionmatched;
+  cv::Mat previousgray;
+  Clock::time_point previoustime;
+};
+
+#endif
@@ -0,0 +1,46 @@
+#include "Preprocessing.hpp"
+
+#include <algorithm>
+
+cv::Size pictureSize(const cv::Mat& frame, PixelFormat format)
+{
+  if (format == PixelFormat::BGR)
+  {
+    return frame.size();
+  }
+  return cv::Size(frame.cols, frame.rows * 2 / 3);
+}
+
+bbox_t InputTransform::toSource(const bbox_t& box) const
+{
+  float x = static_cast<float>(box.x) - offsetx;
+  float y = static_cast<float>(box.y) - offsety;
+  float left = std::clamp(x / scalex, 0.0f, static_cast<float>(sourcesize.width));
+  float top = std::clamp(y / scaley, 0.0f, static_cast<float>(sourcesize.height));
+  float right = std::clamp((x + box.w) / scalex, 0.0f, static_cast<float>(sourcesize.width));
+  float bottom = std::clamp((y + box.h) / scaley, 0.0f, static_cast<float>(sourcesize.height));
+
+  bbox_t mapped = box;
+  mapped.x = static_cast<unsigned int>(left);
+  mapped.y = static_cast<unsigned int>(top);
+  mapped.w = static_cast<unsigned int>(right - left);
+  mapped.h = static_cast<unsigned int>(bottom - top);
+  return mapped;
+}
+
+InputTransform computeInputTransform(cv::Size sourcesize, cv::Size networksize, bool letterbox)
+{
+  InputTransform transform;
+  transform.sourcesize = sourcesize;
+  transform.scalex = static_cast<float>(networksize.width) / sourcesize.width;
+  transform.scaley = static_cast<float>(networksize.height) / sourcesize.height;
+  if (letterbox)
+  {
+    float scale = std::min(transform.scalex, transform.scaley);
+    transform.scalex = scale;
+    transform.scaley = scale;
+    transform.offsetx = (networksize.width - static_cast<int>(sourcesize.width * scale)) / 2;
+    transform.offsety = (networksize.height - static_cast<int>(sourcesize.height * scale)) / 2;
+  }
+  return transform;
+}
@@ -0,0 +1,54 @@
+#ifndef PREPROCESSING_H
+#define PREPROCESSING_H
+
+#include <opencv2/opencv.hpp>
+
+#include "YoloDetector.hpp"
+
+/**
+ * Pixel layouts of decoded frames
+ */
+enum class PixelFormat
+{
+  BGR,  ///< interleaved 8-bit BGR, CV_8UC3
+  NV12, ///< 8-bit Y plane followed by interleaved UV plane, CV_8UC1 with height * 3 / 2 rows
+  I420  ///< 8-bit Y plane followed by U and V planes, CV_8UC1 with height * 3 / 2 rows
+};
+
+/**
+ * Returns size of the picture stored in the frame
+ * @param frame - decoded frame
+ * @param format - pixel layout of the frame
+ * @return width and height of the picture in pixels
+ */
+cv::Size pictureSize(const cv::Mat& frame, PixelFormat format);
+
+/**
+ * Describes where a source frame was placed inside the network input
+ */
+struct InputTransform
+{
+  cv::Size sourcesize {0, 0};
+  float scalex = 1.0f;
+  float scaley = 1.0f;
+  int offsetx = 0;
+  int offsety = 0;
+
+  /**
+   * Maps a box found in the network input back to the source frame
+   * @param box - box in network input coordinates
+   * @return box in source frame coordinates, clipped to the frame
+   */
+  bbox_t toSource(const bbox_t& box) const;
+};
+
+/**
+ * Computes placement of a frame inside the network input
+ * @param sourcesize - size of the source frame
+ * @param networksize - size of the network input
+ * @param letterbox - if true, aspect ratio is preserved and the rest of the input is padded
+ * @return transform from the network input back to the source frame
+ */
+InputTransform computeInputTransform(cv::Size sourcesize, cv::Size networksize, bool letterbox);
+
+#endif
@@ -0,0 +1,185 @@
+#include "Profiler.hpp"
+#include "Tracer.hpp"
+
+#include <algorithm>
+
+const char* stageName(Stage stage)
+{
+  switch (stage)
+  {
+    case Stage::Decode: return "decode";
+    case Stage::CaptureWait: return "capture wait";
+    case Stage::HandoffWait: return "handoff wait";
+    case Stage::Preprocess: return "preprocess";
+    case Stage::Inference: return "inference";
+    case Stage::Nms: return "nms";
+    case Stage::Filter: return "filter";
+    case Stage::DrawList: return "draw list";
+    case Stage::TextureUpload: return "texture upload";
+    case Stage::Swap: return "render + swap";
+    case Stage::Frame: return "frame";
+    default: return "unknown";
+  }
+}
+
+int HistogramSnapshot::bucketIndex(uint64_t microseconds)
+{
+  if (microseconds < linearbuckets)
+  {
+    return static_cast<int>(microseconds);
+  }
+  int highestbit = 63 - __builtin_clzll(microseconds);
+  int shift = highestbit - 4;
+  int index = shift * subbuckets + static_cast<int>(microseconds >> shift);
+  return std::min(index, bucketcount - 1);
+}
+
+double HistogramSnapshot::bucketValue(int index)
+{
+  if (index < linearbuckets)
+  {
+    return index;
+  }
+  int shift = index / subbuckets - 1;
+  uint64_t top = index % subbuckets + subbuckets;
+  double lower = static_cast<double>(top << shift);
+  double upper = static_cast<double>((top + 1) << shift);
+  return (lower + upper) / 2.0;
+}
+
+double HistogramSnapshot::percentile(double fraction) const
+{
+  if (count == 0)
+  {
+    return 0.0;
+  }
+  uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(fraction * count + 0.5));
+  uint64_t seen = 0;
+  for (int i = 0; i < bucketcount; i++)
+  {
+    seen += counts[i];
+    if (seen >= rank)
+    {
+      return bucketValue(i) / 1000.0;
+    }
+  }
+  return maximum();
+}
+
+double HistogramSnapshot::mean() const
+{
+  return count > 0 ? static_cast<double>(sum) / count / 1000.0 : 0.0;
+}
+
+double HistogramSnapshot::maximum() const
+{
+  for (int i = bucketcount - 1; i >= 0; i--)
+  {
+    if (counts[i] > 0)
+    {
+      return bucketValue(i) / 1000.0;
+    }
+  }
+  return 0.0;
+}
+
+void LatencyHistogram::record(uint64_t microseconds)
+{
+  // single writer, plain load and store avoid locked read-modify-write instructions
+  std::atomic<uint64_t>& bucket = counts[HistogramSnapshot::bucketIndex(microseconds)];
+  bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  sum.store(sum.load(std::memory_order_relaxed) + microseconds, std::memory_order_relaxed);
+  lastsample.store(microseconds, std::memory_order_relaxed);
+  count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void LatencyHistogram::accumulate(HistogramSnapshot& snapshot) const
+{
+  snapshot.count += count.load(std::memory_order_acquire);
+  snapshot.sum += sum.load(std::memory_order_relaxed);
+  for (int i = 0; i < HistogramSnapshot::bucketcount; i++)
+  {
+    snapshot.counts[i] += counts[i].load(std::memory_order_relaxed);
+  }
+}
+
+uint64_t LatencyHistogram::last() const
+{
+  return lastsample.load(std::memory_order_relaxed);
+}
+
+Profiler& Profiler::instance()
+{
+  static Profiler profiler;
+  return profiler;
+}
+
+Profiler::ThreadHistograms& Profiler::threadHistograms()
+{
+  thread_local ThreadHistograms* histograms = nullptr;
+  if (!histograms)
+  {
+    Profiler& profiler = instance();
+    std::lock_guard<std::mutex> guard(profiler.registrymutex);
+    profiler.threads.push_back(std::make_unique<ThreadHistograms>());
+    histograms = profiler.threads.back().get();
+  }
+  return *histograms;
+}
+
+void Profiler::record(Stage stage, Clock::time_point start, Clock::time_point end)
+{
+  uint64_t microseconds = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+  threadHistograms().stages[static_cast<size_t>(stage)].record(microseconds);
+  if (Tracer::enabled())
+  {
+    Tracer::record(stage, start, end);
+  }
+}
+
+HistogramSnapshot Profiler::accumulate(Stage stage)
+{
+  HistogramSnapshot snapshot;
+  for (const std::unique_ptr<ThreadHistograms>& histograms : threads)
+  {
+    histograms->stages[static_cast<size_t>(stage)].accumulate(snapshot);
+  }
+  return snapshot;
+}
+
+HistogramSnapshot Profiler::snapshot(Stage stage)
+{
+  Profiler& profiler = instance();
+  std::lock_guard<std::mutex> guard(profiler.registrymutex);
+  HistogramSnapshot snapshot = profiler.accumulate(stage);
+  const HistogramSnapshot& baseline = profiler.baselines[static_cast<size_t>(stage)];
+  snapshot.count -= baseline.count;
+  snapshot.sum -= baseline.sum;
+  for (int i = 0; i < HistogramSnapshot::bucketcount; i++)
+  {
+    snapshot.counts[i] -= baseline.counts[i];
+  }
+  return snapshot;
+}
+
+double Profiler::last(Stage stage)
+{
+  Profiler& profiler = instance();
+  std::lock_guard<std::mutex> guard(profiler.registrymutex);
+  uint64_t latest = 0;
+  for (const std::unique_ptr<ThreadHistograms>& histograms : profiler.threads)
+  {
+    latest = std::max(latest, histograms->stages[static_cast<size_t>(stage)].last());
+  }
+  return latest / 1000.0;
+}
+
+void Profiler::reset()
+{
+  Profiler& profiler = instance();
+  std::lock_guard<std::mutex> guard(profiler.registrymutex);
+  for (size_t stage = 0; stage < profiler.baselines.size(); stage++)
+  {
+    profiler.baselines[stage] = profiler.accumulate(static_cast<Stage>(stage));
+  }
+}
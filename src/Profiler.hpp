@@ -0,0 +1,211 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * Pipeline stages measured by the profiler
+ */
+enum class Stage
+{
+  Decode,        ///< reading a frame from the capture object
+  CaptureWait,   ///< render or headless loop waiting for a decoded frame
+  HandoffWait,   ///< detection thread waiting for a new frame
+  Preprocess,    ///< fused resize, colour conversion and normalization
+  Inference,     ///< darknet network
+  Nms,           ///< non-maximum suppression of detected boxes
+  Filter,        ///< threshold and class filtering of detections
+  DrawList,      ///< building ImGui draw lists
+  TextureUpload, ///< copying the frame into pixel buffers and textures
+  Swap,          ///< rendering draw lists and swapping buffers
+  Frame,         ///< whole render loop iteration
+  Count
+};
+
+/**
+ * Returns the display name of the stage.
+ *
+ * @param stage measured stage
+ * @return name of the stage
+ */
+const char* stageName(Stage stage);
+
+/**
+ * Copy of histogram counters, used to compute statistics
+ */
+struct HistogramSnapshot
+{
+  static constexpr int linearbuckets = 32;
+  static constexpr int subbuckets = 16;
+  static constexpr int bucketcount = 464;
+
+  std::array<uint64_t, bucketcount> counts {};
+  uint64_t count = 0;
+  uint64_t sum = 0;
+
+  /**
+   * Returns the value below which the given fraction of samples falls.
+   *
+   * @param fraction value between 0 and 1
+   * @return latency in milliseconds, with the precision of the bucket
+   */
+  double percentile(double fraction) const;
+
+  /**
+   * Returns the mean of all samples.
+   *
+   * @return mean latency in milliseconds
+   */
+  double mean() const;
+
+  /**
+   * Returns the longest recorded sample.
+   *
+   * @return maximum latency in milliseconds, with the precision of the bucket
+   */
+  double maximum() const;
+
+  /**
+   * Returns the bucket the value in microseconds falls into.
+   *
+   * Values below 32 us have their own buckets, larger values are split into
+   * 16 buckets per power of two, giving about 6% relative precision.
+   *
+   * @param microseconds recorded value
+   * @return bucket index
+   */
+  static int bucketIndex(uint64_t microseconds);
+
+  /**
+   * Returns the middle of the value range covered by the bucket.
+   *
+   * @param index bucket index
+   * @return value in microseconds
+   */
+  static double bucketValue(int index);
+};
+
+/**
+ * Log-linear latency histogram written by a single thread and read by any thread without locks
+ */
+class LatencyHistogram
+{
+public:
+  /**
+   * Records the sample, may only be called by the owning thread.
+   *
+   * @param microseconds measured latency
+   */
+  void record(uint64_t microseconds);
+
+  /**
+   * Adds the counters to the snapshot (thread-safe).
+   *
+   * @param snapshot receives the sum of counters
+   */
+  void accumulate(HistogramSnapshot& snapshot) const;
+
+  /**
+   * Returns the last recorded sample (thread-safe).
+   *
+   * @return latency in microseconds
+   */
+  uint64_t last() const;
+
+private:
+  std::array<std::atomic<uint64_t>, HistogramSnapshot::bucketcount> counts {};
+  std::atomic<uint64_t> count = 0;
+  std::atomic<uint64_t> sum = 0;
+  std::atomic<uint64_t> lastsample = 0;
+};
+
+/**
+ * Collects stage latencies from all threads.
+ *
+ * Every thread records into its own set of histograms, registered on first use,
+ * so recording never takes a lock. Readers sum the histograms of all threads.
+ */
+class Profiler
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  /**
+   * Records latency of the stage in the histograms of the calling thread,
+   * and in the trace when tracing is enabled.
+   *
+   * @param stage measured stage
+   * @param start time the stage began
+   * @param end time the stage ended
+   */
+  static void record(Stage stage, Clock::time_point start, Clock::time_point end);
+
+  /**
+   * Returns statistics of the stage summed over all threads since the last reset (thread-safe).
+   *
+   * @param stage measured stage
+   * @return histogram snapshot
+   */
+  static HistogramSnapshot snapshot(Stage stage);
+
+  /**
+   * Returns the last latency recorded for the stage by any thread (thread-safe).
+   *
+   * @param stage measured stage
+   * @return latency in milliseconds
+   */
+  static double last(Stage stage);
+
+  /**
+   * Makes following snapshots count only samples recorded after this call (thread-safe).
+   */
+  static void reset();
+
+private:
+  struct ThreadHistograms
+  {
+    std::array<LatencyHistogram, static_cast<size_t>(Stage::Count)> stages;
+  };
+
+  static Profiler& instance();
+  static ThreadHistograms& threadHistograms();
+
+  HistogramSnapshot accumulate(Stage stage);
+
+  std::mutex registrymutex;
+  std::deque<std::unique_ptr<ThreadHistograms>> threads;
+  std::array<HistogramSnapshot, static_cast<size_t>(Stage::Count)> baselines;
+};
+
+/**
+ * Records the time from construction to destruction as latency of the stage
+ */
+class ScopedTimer
+{
+public:
+  explicit ScopedTimer(Stage stage) :
+    stage(stage),
+    start(Profiler::Clock::now())
+  {}
+
+  ~ScopedTimer()
+  {
+    Profiler::record(stage, start, Profiler::Clock::now());
+  }
+
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+  Stage stage;
+  Profiler::Clock::time_point start;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include "ProfilerPanel.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+
+#include "MemoryUsage.hpp"
+
+void ProfilerPanel::update()
+{
+  frametimes[historyoffset] = Profiler::last(Stage::Frame);
+  inferencetimes[historyoffset] = Profiler::last(Stage::Inference);
+  frameallocations[historyoffset] = lastframeallocations;
+  historyoffset = (historyoffset + 1) % historysize;
+}
+
+void ProfilerPanel::setFrameAllocations(uint64_t allocations)
+{
+  lastframeallocations = allocations;
+}
+
+void ProfilerPanel::draw(bool* open)
+{
+  if (!ImGui::Begin("Profiler", open))
+  {
+    ImGui::End();
+    return;
+  }
+
+  if (ImGui::Button("Reset"))
+  {
+    Profiler::reset();
+  }
+
+  if (ImGui::BeginTable("Stages", 7))
+  {
+    ImGui::TableSetupColumn("Stage", ImGuiTableColumnFlags_WidthStretch);
+    ImGui::TableSetupColumn("Count");
+    ImGui::TableSetupColumn("Mean");
+    ImGui::TableSetupColumn("p50");
+    ImGui::TableSetupColumn("p95");
+    ImGui::TableSetupColumn("p99");
+    ImGui::TableSetupColumn("Max");
+    ImGui::TableHeadersRow();
+
+    for (int stage = 0; stage < static_cast<int>(Stage::Count); stage++)
+    {
+      HistogramSnapshot snapshot = Profiler::snapshot(static_cast<Stage>(stage));
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(stageName(static_cast<Stage>(stage)));
+      ImGui::TableNextColumn();
+      ImGui::Text("%llu", static_cast<unsigned long long>(snapshot.count));
+      ImGui::TableNextColumn();
+      ImGui::Text("%.2f", snapshot.mean());
+      ImGui::TableNextColumn();
+      ImGui::Text("%.2f", snapshot.percentile(0.50));
+      ImGui::TableNextColumn();
+      ImGui::Text("%.2f", snapshot.percentile(0.95));
+      ImGui::TableNextColumn();
+      ImGui::Text("%.2f", snapshot.percentile(0.99));
+      ImGui::TableNextColumn();
+      ImGui::Text("%.2f", snapshot.maximum());
+    }
+    ImGui::EndTable();
+  }
+  ImGui::TextUnformatted("All values in milliseconds");
+  if (allocationsCounted())
+  {
+    ImGui::Text("Render thread heap allocations: %llu last frame, %llu max over last %d frames",
+        static_cast<unsigned long long>(lastframeallocations),
+        static_cast<unsigned long long>(*std::max_element(frameallocations.begin(), frameallocations.end())),
+        historysize);
+  }
+  else
+  {
+    ImGui::TextUnformatted("Heap allocations are counted in builds with COUNT_ALLOCATIONS enabled");
+  }
+
+  char overlay[32];
+  snprintf(overlay, sizeof(overlay), "%.2f ms", Profiler::last(Stage::Frame));
+  ImGui::PlotLines("Frame time", frametimes.data(), historysize, historyoffset, overlay, 0.0f, FLT_MAX, ImVec2(0, 80));
+  snprintf(overlay, sizeof(overlay), "%.2f ms", Profiler::last(Stage::Inference));
+  ImGui::PlotLines("Inference time", inferencetimes.data(), historysize, historyoffset, overlay, 0.0f, FLT_MAX, ImVec2(0, 80));
+
+  ImGui::End();
+}
@@ -0,0 +1,46 @@
+#ifndef PROFILERPANEL_H
+#define PROFILERPANEL_H
+
+#include <array>
+#include <cstdint>
+
+#include "imgui.h"
+
+#include "Profiler.hpp"
+
+/**
+ * ImGui window with latency percentiles of all pipeline stages and frame time graphs
+ */
+class ProfilerPanel
+{
+public:
+  /**
+   * Appends the latest frame and inference latencies to the graphs, called once per rendered frame.
+   */
+  void update();
+
+  /**
+   * Sets the number of heap allocations made by the render thread during the last frame.
+   *
+   * @param allocations allocations counted by threadAllocations()
+   */
+  void setFrameAllocations(uint64_t allocations);
+
+  /**
+   * Draws the panel window.
+   *
+   * @param open set to false when the window is closed by the user
+   */
+  void draw(bool* open);
+
+private:
+  static constexpr int historysize = 240;
+
+  std::array<float, historysize> frametimes {};
+  std::array<float, historysize> inferencetimes {};
+  std::array<uint64_t, historysize> frameallocations {};
+  int historyoffset = 0;
+  uint64_t lastframeallocations = 0;
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include "RegionsOfInterest.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+void RegionsOfInterest::load(const std::string& path)
+{
+  std::ifstream file(path);
+  if (!file)
+  {
+    throw std::runtime_error("Failed to open regions of interest file " + path);
+  }
+  std::vector<std::vector<cv::Point2f>> loaded;
+  std::string line;
+  while (std::getline(file, line))
+  {
+    if (line.empty() || line[0] == '#')
+    {
+      continue;
+    }
+    std::vector<cv::Point2f> polygon;
+    std::stringstream stream(line);
+    std::string vertex;
+    while (stream >> vertex)
+    {
+      float x, y;
+      char separator;
+      std::stringstream coordinates(vertex);
+      if (!(coordinates >> x >> separator >> y) || separator != ',')
+      {
+        throw std::runtime_error("Invalid vertex \"" + vertex + "\" in regions of interest file " + path);
+      }
+      polygon.emplace_back(x, y);
+    }
+    if (polygon.size() < 3)
+    {
+      throw std::runtime_error("Region with less than 3 vertices in regions of interest file " + path);
+    }
+    loaded.push_back(polygon);
+  }
+  regions = loaded;
+  regionsversion++;
+}
+
+void RegionsOfInterest::save(const std::string& path) const
+{
+  std::ofstream file(path);
+  if (!file)
+  {
+    throw std::runtime_error("Failed to write regions of interest file " + path);
+  }
+  file << "# one polygon per line, vertices as x,y in source frame pixels\n";
+  for (const std::vector<cv::Point2f>& polygon : regions)
+  {
+    for (size_t i = 0; i < polygon.size(); i++)
+    {
+      file << (i ? " " : "") << polygon[i].x << "," << polygon[i].y;
+    }
+    file << "\n";
+  }
+}
+
+void RegionsOfInterest::add(const std::vector<cv::Point2f>& polygon)
+{
+  if (polygon.size() < 3)
+  {
+    return;
+  }
+  regions.push_back(polygon);
+  regionsversion++;
+}
+
+void RegionsOfInterest::clear()
+{
+  regions.clear();
+  regionsversion++;
+}
+
+bool RegionsOfInterest::empty() const
+{
+  return regions.empty();
+}
+
+const std::vector<std::vector<cv::Point2f>>& RegionsOfInterest::polygons() const
+{
+  return regions;
+}
+
+uint64_t RegionsOfInterest::version() const
+{
+  return regionsversion;
+}
+
+std::vector<cv::Rect> RegionsOfInterest::crops(cv::Size framesize) const
+{
+  const cv::Rect frame(cv::Point(0, 0), framesize);
+  if (regions.empty())
+  {
+    return {frame};
+  }
+
+  std::vector<cv::Rect> bounds;
+  for (const std::vector<cv::Point2f>& polygon : regions)
+  {
+    cv::Rect bound = cv::boundingRect(polygon) & frame;
+    if (bound.area() > 0)
+    {
+      bounds.push_back(bound);
+    }
+  }
+
+  // overlapping rectangles are merged, so no pixel is passed to the network twice
+  bool merged = true;
+  while (merged)
+  {
+    merged = false;
+    for (size_t i = 0; i < bounds.size() && !merged; i++)
+    {
+      for (size_t j = i + 1; j < bounds.size() && !merged; j++)
+      {
+        if ((bounds[i] & bounds[j]).area() > 0)
+        {
+          bounds[i] |= bounds[j];
+          bounds.erase(bounds.begin() + j);
+          merged = true;
+        }
+      }
+    }
+  }
+
+  return bounds;
+}
+
+bool RegionsOfInterest::contains(const bbox_t& object) const
+{
+  if (regions.empty())
+  {
+    return true;
+  }
+  cv::Point2f center(object.x + object.w / 2.0f, object.y + object.h / 2.0f);
+  for (const std::vector<cv::Point2f>& polygon : regions)
+  {
+    if (cv::pointPolygonTest(polygon, center, false) >= 0)
+    {
+      return true;
+    }
+  }
+  return false;
+}
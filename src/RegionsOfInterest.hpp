@@ -0,0 +1,91 @@
+#ifndef REGIONSOFINTEREST_H
+#define REGIONSOFINTEREST_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "YoloDetector.hpp"
+
+/**
+ * Polygons marking the parts of the frame where objects are detected, in source frame pixels.
+ *
+ * The detector runs only on the bounding rectangles of the polygons, merged where they overlap, and objects whose
+ * center lies outside every polygon are discarded. The rectangles are split into tiles by appendTiles() like
+ * whole frames. No polygon means the whole frame is used.
+ */
+class RegionsOfInterest
+{
+public:
+  /**
+   * Reads polygons from the file, one polygon per line as space-separated "x,y" vertices.
+   * Empty lines and lines starting with # are skipped.
+   *
+   * @param path path to the file
+   */
+  void load(const std::string& path);
+
+  /**
+   * Writes polygons to the file in the format read by load().
+   *
+   * @param path path to the file
+   */
+  void save(const std::string& path) const;
+
+  /**
+   * Adds a polygon, ignored if it has less than 3 vertices.
+   *
+   * @param polygon vertices in source frame pixels
+   */
+  void add(const std::vector<cv::Point2f>& polygon);
+
+  /**
+   * Removes all polygons.
+   */
+  void clear();
+
+  /**
+   * Tells if there are no polygons.
+   *
+   * @return true if the whole frame is used
+   */
+  bool empty() const;
+
+  /**
+   * Returns the polygons.
+   *
+   * @return vertices of every polygon in source frame pixels
+   */
+  const std::vector<std::vector<cv::Point2f>>& polygons() const;
+
+  /**
+   * Returns the number of changes of the polygons, used to detect changes cheaply.
+   *
+   * @return version of the polygons
+   */
+  uint64_t version() const;
+
+  /**
+   * Computes the bounding rectangles of the polygons, merged where they overlap.
+   *
+   * @param framesize size of the source frame
+   * @return crops inside the frame, the whole frame if there are no polygons
+   */
+  std::vector<cv::Rect> crops(cv::Size framesize) const;
+
+  /**
+   * Tells if the center of the object lies inside any polygon.
+   *
+   * @param object detected object in source frame pixels
+   * @return true if the object is kept, always true if there are no polygons
+   */
+  bool contains(const bbox_t& object) const;
+
+private:
+  std::vector<std::vector<cv::Point2f>> regions;
+  uint64_t regionsversion = 0;
+};
+
+#endif
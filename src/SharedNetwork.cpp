@@ -0,0 +1,260 @@
+#include "SharedNetwork.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+#include "darknet.h"
+
+#include "ClassFilter.hpp"
+
+/**
+ * Points the weight arrays of the layer to the arrays of the prototype layer,
+ * freeing the arrays allocated by the parser. Does nothing for arrays missing in either layer.
+ */
+static void shareArray(float*& instance, float* prototype)
+{
+  if (instance && prototype)
+  {
+    free(instance);
+    instance = prototype;
+  }
+}
+
+/**
+ * Clears the pointer of the layer if it points to the array of the prototype layer,
+ * so that free_network frees only arrays owned by the instance.
+ */
+static void unshareArray(float*& instance, const float* prototype)
+{
+  if (instance && instance == prototype)
+  {
+    instance = nullptr;
+  }
+}
+
+/**
+ * Throws if weights of the layer are kept outside of the arrays shared by SharedNetwork
+ */
+static void checkShareable(const layer& l)
+{
+  switch (l.type)
+  {
+    case RNN:
+    case GRU:
+    case LSTM:
+    case CONV_LSTM:
+    case CRNN:
+    case HISTORY:
+      throw std::runtime_error("Sharing weights of recurrent layers is not supported");
+    default:
+      break;
+  }
+  if (l.xnor || l.binary)
+  {
+    throw std::runtime_error("Sharing weights of binary layers is not supported");
+  }
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+NetworkWeights::NetworkWeights(const std::string& cfgfile, const std::string& weightsfile, const std::string& cachedirectory) :
+  cfgfile(cfgfile)
+{
+#ifdef GPU
+  // the parser allocates weights_gpu of every instance, which is never filled from the shared arrays
+  if (gpu_index >= 0)
+  {
+    throw std::runtime_error("Shared network weights and the weights cache require a CPU build of darknet");
+  }
+#endif
+  prototype = new network(parse_network_cfg_custom(const_cast<char*>(cfgfile.c_str()), 1, 1));
+  for (int i = 0; i < prototype->n; i++)
+  {
+    checkShareable(prototype->layers[i]);
+  }
+  set_batch_network(prototype, 1);
+
+  if (cachedirectory != "")
+  {
+    cache = std::make_unique<WeightsCache>(cachedirectory, cfgfile, weightsfile);
+    if (cache->map(*prototype))
+    {
+      std::cout << "Warm weights cache: mapped " << cache->path() << std::endl;
+      return;
+    }
+  }
+
+  load_weights(prototype, const_cast<char*>(weightsfile.c_str()));
+  fuse_conv_batchnorm(*prototype);
+  if (cache)
+  {
+    std::cout << "Cold weights cache: loaded " << weightsfile << std::endl;
+  }
+
+  if (cache)
+  {
+    auto writestart = std::chrono::steady_clock::now();
+    if (cache->write(*prototype))
+    {
+      std::cout << "Wrote weights cache " << cache->path() << " in " << millisecondsSince(writestart) << " ms" << std::endl;
+    }
+  }
+}
+
+NetworkWeights::~NetworkWeights()
+{
+  if (cache)
+  {
+    cache->detach(*prototype);
+  }
+  free_network(*prototype);
+  delete prototype;
+}
+
+const std::string& NetworkWeights::cfgFile() const
+{
+  return cfgfile;
+}
+
+SharedNetwork::SharedNetwork(std::shared_ptr<const NetworkWeights> weights) :
+  weights(weights)
+{
+  if (!weights->prototypeinuse.exchange(true))
+  {
+    // the prototype has activation buffers of its own, so the first instance saves parsing the cfg file again
+    net = weights->prototype;
+    ownsnetwork = false;
+    return;
+  }
+  net = new network(parse_network_cfg_custom(const_cast<char*>(weights->cfgfile.c_str()), 1, 1));
+  const network& prototype = *weights->prototype;
+  if (net->n != prototype.n)
+  {
+    free_network(*net);
+    delete net;
+    throw std::runtime_error("Network does not match the shared weights");
+  }
+
+  for (int i = 0; i < net->n; i++)
+  {
+    layer& l = net->layers[i];
+    const layer& p = prototype.layers[i];
+    if (l.share_layer)
+    {
+      // arrays of such layers belong to the layer they are shared with and are updated below
+      continue;
+    }
+    shareArray(l.weights, p.weights);
+    shareArray(l.biases, p.biases);
+    shareArray(l.scales, p.scales);
+    shareArray(l.rolling_mean, p.rolling_mean);
+    shareArray(l.rolling_variance, p.rolling_variance);
+    // batch normalization and normalization of shortcut weights are already fused into the shared weights
+    l.batch_normalize = p.batch_normalize;
+    l.weights_normalization = p.weights_normalization;
+  }
+  for (int i = 0; i < net->n; i++)
+  {
+    layer& l = net->layers[i];
+    if (l.share_layer)
+    {
+      l.weights = l.share_layer->weights;
+      l.biases = l.share_layer->biases;
+      l.scales = l.share_layer->scales;
+      l.rolling_mean = l.share_layer->rolling_mean;
+      l.rolling_variance = l.share_layer->rolling_variance;
+      l.batch_normalize = prototype.layers[i].batch_normalize;
+      l.weights_normalization = prototype.layers[i].weights_normalization;
+    }
+  }
+}
+
+SharedNetwork::~SharedNetwork()
+{
+  if (!ownsnetwork)
+  {
+    weights->prototypeinuse = false;
+    return;
+  }
+  // shared arrays are owned by the prototype, they must not be freed with this instance;
+  // arrays the prototype freed when fusing batch normalization were kept and are freed here
+  const network& prototype = *weights->prototype;
+  for (int i = 0; i < net->n; i++)
+  {
+    layer& l = net->layers[i];
+    const layer& p = prototype.layers[i];
+    unshareArray(l.weights, p.weights);
+    unshareArray(l.biases, p.biases);
+    unshareArray(l.scales, p.scales);
+    unshareArray(l.rolling_mean, p.rolling_mean);
+    unshareArray(l.rolling_variance, p.rolling_variance);
+  }
+  free_network(*net);
+  delete net;
+}
+
+std::vector<bbox_t> SharedNetwork::detect(image_t input, float thresh, const std::vector<uint64_t>& classmask)
+{
+  network_predict_ptr(net, input.data);
+
+  int count = 0;
+  detection* detections = get_network_boxes(net, net->w, net->h, thresh, 0.5f, nullptr, 1, &count, 0);
+  int classes = net->layers[net->n - 1].classes;
+  if (!classmask.empty())
+  {
+    // zeroed classes are skipped by non-maximum suppression and never become the best class
+    for (int i = 0; i < count; i++)
+    {
+      for (int c = 0; c < classes; c++)
+      {
+        if (!maskAccepts(classmask, c))
+        {
+          detections[i].prob[c] = 0.0f;
+        }
+      }
+    }
+  }
+  if (nms > 0.0f)
+  {
+    do_nms_sort(detections, count, classes, nms);
+  }
+
+  std::vector<bbox_t> objects;
+  for (int i = 0; i < count; i++)
+  {
+    const detection& d = detections[i];
+    int best = static_cast<int>(std::max_element(d.prob, d.prob + d.classes) - d.prob);
+    if (d.prob[best] <= thresh)
+    {
+      continue;
+    }
+    // boxes reaching past the input are cut at its border, as Detector::detect does
+    const float width = static_cast<float>(net->w);
+    const float height = static_cast<float>(net->h);
+    float left = std::clamp((d.bbox.x - d.bbox.w / 2.0f) * width, 0.0f, width);
+    float top = std::clamp((d.bbox.y - d.bbox.h / 2.0f) * height, 0.0f, height);
+    float right = std::clamp((d.bbox.x + d.bbox.w / 2.0f) * width, left, width);
+    float bottom = std::clamp((d.bbox.y + d.bbox.h / 2.0f) * height, top, height);
+    bbox_t object {};
+    object.x = static_cast<unsigned int>(left);
+    object.y = static_cast<unsigned int>(top);
+    object.w = static_cast<unsigned int>(right - left);
+    object.h = static_cast<unsigned int>(bottom - top);
+    object.prob = d.prob[best];
+    object.obj_id = best;
+    objects.push_back(object);
+  }
+  free_detections(detections, count);
+  return objects;
+}
+
+cv::Size SharedNetwork::getNetworkSize() const
+{
+  return cv::Size(net->w, net->h);
+}
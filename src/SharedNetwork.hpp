@@ -0,0 +1,105 @@
+#ifndef SHAREDNETWORK_H
+#define SHAREDNETWORK_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "YoloDetector.hpp"
+
+#include "WeightsCache.hpp"
+
+struct network;
+
+/**
+ * Network weights loaded once and shared read-only by SharedNetwork instances.
+ *
+ * Holds a fully loaded prototype network with batch normalization fused into the weights,
+ * as done by darknet's Detector. With a cache directory, the fused weights are mapped
+ * from the cache file, which is created from the weights file on the first run.
+ */
+class NetworkWeights
+{
+public:
+  /**
+   * Parses the model and loads its weights, throws in GPU builds of darknet that use a device
+   * @param cfgfile - path to the config file defining model
+   * @param weightsfile - path to the file containing weights
+   * @param cachedirectory - directory of the weights cache, empty to always read the weights file
+   */
+  NetworkWeights(const std::string& cfgfile, const std::string& weightsfile, const std::string& cachedirectory = "");
+  ~NetworkWeights();
+
+  NetworkWeights(const NetworkWeights&) = delete;
+  NetworkWeights& operator=(const NetworkWeights&) = delete;
+
+  /**
+   * Returns the path to the config file the prototype was parsed from.
+   *
+   * @return config file path
+   */
+  const std::string& cfgFile() const;
+
+private:
+  friend class SharedNetwork;
+
+  std::string cfgfile;
+  network* prototype = nullptr;
+  // set while a SharedNetwork runs on the prototype itself
+  mutable std::atomic<bool> prototypeinuse {false};
+  std::unique_ptr<WeightsCache> cache;
+};
+
+/**
+ * Network instance with its own activation buffers and weights borrowed from NetworkWeights.
+ *
+ * The first instance runs on the prototype network itself. Later instances parse the model again
+ * and allocate only arrays written during inference, so every additional instance costs
+ * the activation and workspace memory of the network, not its weights.
+ * Inference runs on the CPU only: instances never fill the device copies of the weights,
+ * so NetworkWeights throws in GPU builds of darknet unless gpu_index is -1.
+ */
+class SharedNetwork
+{
+public:
+  /**
+   * Takes the prototype network if no other instance uses it,
+   * otherwise parses the model and points its layers to the shared weights
+   * @param weights - loaded weights, kept alive as long as this instance exists
+   */
+  SharedNetwork(std::shared_ptr<const NetworkWeights> weights);
+  ~SharedNetwork();
+
+  SharedNetwork(const SharedNetwork&) = delete;
+  SharedNetwork& operator=(const SharedNetwork&) = delete;
+
+  /**
+   * Runs the network on the input and returns objects with probability above the threshold.
+   *
+   * @param input network-sized planar RGB image
+   * @param thresh minimum probability of returned objects
+   * @param classmask classes to keep, see ClassFilter, empty keeps all; other classes are dropped before non-maximum suppression
+   * @return detected objects in network input coordinates, after non-maximum suppression
+   */
+  std::vector<bbox_t> detect(image_t input, float thresh = 0.2f, const std::vector<uint64_t>& classmask = {});
+
+  /**
+   * Returns the size of the network input.
+   *
+   * @return network width and height
+   */
+  cv::Size getNetworkSize() const;
+
+  float nms = 0.4f; ///< IoU threshold of non-maximum suppression, 0 disables it
+
+private:
+  std::shared_ptr<const NetworkWeights> weights;
+  network* net = nullptr;
+  bool ownsnetwork = true; ///< false if net is the prototype of the weights
+};
+
+#endif
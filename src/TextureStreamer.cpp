@@ -0,0 +1,359 @@
+#include "TextureStreamer.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+const GLuint64 fencetimeout = 1000000000; // nanoseconds
+
+const char* vertexshader = R"(
+uniform mat4 ProjMtx;
+in vec2 Position;
+in vec2 UV;
+out vec2 Frag_UV;
+void main()
+{
+  Frag_UV = UV;
+  gl_Position = ProjMtx * vec4(Position.xy, 0.0, 1.0);
+}
+)";
+
+// Format: 0 - BGR, 1 - NV12, 2 - I420; YUV is BT.601 limited range
+const char* fragmentshader = R"(
+uniform sampler2D PlaneY;
+uniform sampler2D PlaneU;
+uniform sampler2D PlaneV;
+uniform int Format;
+in vec2 Frag_UV;
+out vec4 Out_Color;
+void main()
+{
+  if (Format == 0)
+  {
+    Out_Color = vec4(texture(PlaneY, Frag_UV).bgr, 1.0);
+    return;
+  }
+  float y = 1.164 * (texture(PlaneY, Frag_UV).r - 16.0 / 255.0);
+  vec2 uv;
+  if (Format == 1)
+  {
+    uv = texture(PlaneU, Frag_UV).rg;
+  }
+  else
+  {
+    uv = vec2(texture(PlaneU, Frag_UV).r, texture(PlaneV, Frag_UV).r);
+  }
+  uv -= vec2(0.5);
+  Out_Color = vec4(
+    clamp(vec3(
+      y + 1.596 * uv.y,
+      y - 0.391 * uv.x - 0.813 * uv.y,
+      y + 2.018 * uv.x), 0.0, 1.0),
+    1.0);
+}
+)";
+
+GLuint compileShader(GLenum type, const std::string& source)
+{
+  GLuint shader = glCreateShader(type);
+  const char* text = source.c_str();
+  glShaderSource(shader, 1, &text, nullptr);
+  glCompileShader(shader);
+  GLint status = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  if (status != GL_TRUE)
+  {
+    char log[1024];
+    glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+    std::cerr << "Failed to compile colour conversion shader:" << std::endl << log << std::endl;
+  }
+  return shader;
+}
+}
+
+TextureStreamer::TextureStreamer(std::string glslversion, int ringsize, bool allowpersistent) :
+  glslversion(glslversion),
+  ringsize(std::max(ringsize, 1)),
+  allowpersistent(allowpersistent)
+{}
+
+TextureStreamer::~TextureStreamer()
+{
+  release();
+}
+
+void TextureStreamer::release()
+{
+  releaseTextures();
+  if (program)
+  {
+    glDeleteProgram(program);
+    program = 0;
+  }
+}
+
+void TextureStreamer::releaseTextures()
+{
+  for (PixelBuffer& pixelbuffer : ring)
+  {
+    if (pixelbuffer.fence)
+    {
+      glDeleteSync(pixelbuffer.fence);
+    }
+    if (pixelbuffer.mapped)
+    {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelbuffer.buffer);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+    glDeleteBuffers(1, &pixelbuffer.buffer);
+  }
+  if (!ring.empty())
+  {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+  ring.clear();
+  for (Plane& plane : planes)
+  {
+    glDeleteTextures(1, &plane.texture);
+  }
+  planes.clear();
+  picturesize = cv::Size(0, 0);
+}
+
+void TextureStreamer::createProgram()
+{
+  GLuint vertex = compileShader(GL_VERTEX_SHADER, glslversion + "\n" + vertexshader);
+  GLuint fragment = compileShader(GL_FRAGMENT_SHADER, glslversion + "\n" + fragmentshader);
+  program = glCreateProgram();
+  glAttachShader(program, vertex);
+  glAttachShader(program, fragment);
+  glLinkProgram(program);
+  GLint status = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (status != GL_TRUE)
+  {
+    char log[1024];
+    glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+    std::cerr << "Failed to link colour conversion shader:" << std::endl << log << std::endl;
+  }
+  glDetachShader(program, vertex);
+  glDetachShader(program, fragment);
+  glDeleteShader(vertex);
+  glDeleteShader(fragment);
+
+  projectionlocation = glGetUniformLocation(program, "ProjMtx");
+  formatlocation = glGetUniformLocation(program, "Format");
+  positionlocation = glGetAttribLocation(program, "Position");
+  uvlocation = glGetAttribLocation(program, "UV");
+
+  GLint currentprogram = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &currentprogram);
+  glUseProgram(program);
+  glUniform1i(glGetUniformLocation(program, "PlaneY"), 0);
+  glUniform1i(glGetUniformLocation(program, "PlaneU"), 1);
+  glUniform1i(glGetUniformLocation(program, "PlaneV"), 2);
+  glUseProgram(currentprogram);
+}
+
+void TextureStreamer::allocate(cv::Size size, PixelFormat format, size_t framebytes)
+{
+  releaseTextures();
+  if (!program)
+  {
+    createProgram();
+  }
+
+  persistent = allowpersistent && GLEW_ARB_buffer_storage;
+  picturesize = size;
+  pixelformat = format;
+  buffersize = framebytes;
+
+  const size_t lumabytes = static_cast<size_t>(size.area());
+  const cv::Size chromasize(size.width / 2, size.height / 2);
+  switch (format)
+  {
+    case PixelFormat::BGR:
+      planes.push_back({0, size, GL_RGB8, GL_RGB, 0});
+      break;
+    case PixelFormat::NV12:
+      planes.push_back({0, size, GL_R8, GL_RED, 0});
+      planes.push_back({0, chromasize, GL_RG8, GL_RG, lumabytes});
+      break;
+    case PixelFormat::I420:
+      planes.push_back({0, size, GL_R8, GL_RED, 0});
+      planes.push_back({0, chromasize, GL_R8, GL_RED, lumabytes});
+      planes.push_back({0, chromasize, GL_R8, GL_RED, lumabytes + chromasize.area()});
+      break;
+  }
+
+  for (Plane& plane : planes)
+  {
+    glGenTextures(1, &plane.texture);
+    glBindTexture(GL_TEXTURE_2D, plane.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (GLEW_ARB_texture_storage)
+    {
+      glTexStorage2D(GL_TEXTURE_2D, 1, plane.internalformat, plane.size.width, plane.size.height);
+    }
+    else
+    {
+      glTexImage2D(GL_TEXTURE_2D, 0, plane.internalformat, plane.size.width, plane.size.height, 0,
+          plane.format, GL_UNSIGNED_BYTE, nullptr);
+    }
+  }
+
+  ring.resize(ringsize);
+  for (PixelBuffer& pixelbuffer : ring)
+  {
+    glGenBuffers(1, &pixelbuffer.buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelbuffer.buffer);
+    if (persistent)
+    {
+      GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      glBufferStorage(GL_PIXEL_UNPACK_BUFFER, buffersize, nullptr, flags);
+      pixelbuffer.mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, buffersize, flags);
+    }
+    else
+    {
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, buffersize, nullptr, GL_STREAM_DRAW);
+    }
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  nextbuffer = 0;
+
+  std::cout << "Allocated " << size.width << " x " << size.height << " frame textures ("
+    << planes.size() << " planes) with " << ringsize
+    << (persistent ? " persistently mapped" : " orphaned") << " pixel buffers" << std::endl;
+}
+
+void TextureStreamer::waitForBuffer(PixelBuffer& pixelbuffer)
+{
+  if (!pixelbuffer.fence)
+  {
+    return;
+  }
+  if (glClientWaitSync(pixelbuffer.fence, GL_SYNC_FLUSH_COMMANDS_BIT, fencetimeout) == GL_WAIT_FAILED)
+  {
+    perror("Failed to wait for pixel buffer fence");
+  }
+  glDeleteSync(pixelbuffer.fence);
+  pixelbuffer.fence = nullptr;
+}
+
+void TextureStreamer::upload(const cv::Mat& frame, PixelFormat format)
+{
+  if (frame.empty())
+  {
+    return;
+  }
+  const size_t rowbytes = frame.cols * frame.elemSize();
+  const size_t framebytes = rowbytes * frame.rows;
+  cv::Size size = pictureSize(frame, format);
+  if (size != picturesize || format != pixelformat)
+  {
+    allocate(size, format, framebytes);
+  }
+
+  PixelBuffer& pixelbuffer = ring[nextbuffer];
+  nextbuffer = (nextbuffer + 1) % ring.size();
+  waitForBuffer(pixelbuffer);
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelbuffer.buffer);
+  void* destination = pixelbuffer.mapped;
+  if (!persistent)
+  {
+    destination = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, buffersize,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  }
+  if (destination)
+  {
+    if (frame.isContinuous())
+    {
+      std::memcpy(destination, frame.data, framebytes);
+    }
+    else
+    {
+      for (int row = 0; row < frame.rows; row++)
+      {
+        std::memcpy(static_cast<uchar*>(destination) + row * rowbytes, frame.ptr(row), rowbytes);
+      }
+    }
+  }
+  if (!persistent)
+  {
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  }
+
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (const Plane& plane : planes)
+  {
+    glBindTexture(GL_TEXTURE_2D, plane.texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, plane.size.width, plane.size.height,
+        plane.format, GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(plane.offset));
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  pixelbuffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureStreamer::draw(ImDrawList* drawlist, ImVec2 upperleft, ImVec2 lowerright)
+{
+  if (planes.empty())
+  {
+    return;
+  }
+  drawlist->AddCallback(TextureStreamer::drawCallback, this);
+  drawlist->AddImage(reinterpret_cast<ImTextureID>(static_cast<intptr_t>(planes[0].texture)), upperleft, lowerright);
+  drawlist->AddCallback(ImDrawCallback_ResetRenderState, nullptr);
+}
+
+void TextureStreamer::drawCallback(const ImDrawList* /*drawlist*/, const ImDrawCmd* command)
+{
+  static_cast<TextureStreamer*>(command->UserCallbackData)->bindProgram();
+}
+
+void TextureStreamer::bindProgram()
+{
+  ImDrawData* drawdata = ImGui::GetDrawData();
+  const float left = drawdata->DisplayPos.x;
+  const float right = drawdata->DisplayPos.x + drawdata->DisplaySize.x;
+  const float top = drawdata->DisplayPos.y;
+  const float bottom = drawdata->DisplayPos.y + drawdata->DisplaySize.y;
+  const float projection[4][4] = {
+    {2.0f / (right - left), 0.0f, 0.0f, 0.0f},
+    {0.0f, 2.0f / (top - bottom), 0.0f, 0.0f},
+    {0.0f, 0.0f, -1.0f, 0.0f},
+    {(right + left) / (left - right), (top + bottom) / (bottom - top), 0.0f, 1.0f},
+  };
+
+  glUseProgram(program);
+  glUniformMatrix4fv(projectionlocation, 1, GL_FALSE, &projection[0][0]);
+  glUniform1i(formatlocation, static_cast<int>(pixelformat));
+
+  // the ImGui backend binds the first plane to unit 0 when drawing the image
+  for (size_t i = 1; i < planes.size(); i++)
+  {
+    glActiveTexture(GL_TEXTURE0 + i);
+    glBindTexture(GL_TEXTURE_2D, planes[i].texture);
+  }
+  glActiveTexture(GL_TEXTURE0);
+
+  // vertex buffer of the draw list is bound by the backend, only attribute locations differ
+  glEnableVertexAttribArray(positionlocation);
+  glVertexAttribPointer(positionlocation, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert),
+      reinterpret_cast<const void*>(offsetof(ImDrawVert, pos)));
+  glEnableVertexAttribArray(uvlocation);
+  glVertexAttribPointer(uvlocation, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert),
+      reinterpret_cast<const void*>(offsetof(ImDrawVert, uv)));
+}
+
+bool TextureStreamer::isPersistent() const
+{
+  return persistent;
+}
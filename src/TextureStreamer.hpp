@@ -0,0 +1,119 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "imgui.h"
+
+#include <opencv2/opencv.hpp>
+
+#include "Preprocessing.hpp"
+
+/**
+ * Streams decoded frames into OpenGL textures through a ring of pixel buffer objects
+ * and converts them to RGB on the GPU.
+ *
+ * Frames are uploaded in their decoded layout: BGR frames into a single RGB texture,
+ * NV12 and I420 frames into one texture per plane. A fragment shader bound through
+ * an ImGui draw callback converts the planes to RGB when the frame is drawn.
+ *
+ * Texture storage is allocated only when the frame size or layout changes. Each upload is written
+ * into the next buffer of the ring and copied into the textures with glTexSubImage2D,
+ * fences keep the CPU from overwriting buffers the GPU still reads from.
+ * Buffers are mapped persistently when ARB_buffer_storage is available,
+ * otherwise they are orphaned and mapped on every upload.
+ */
+class TextureStreamer
+{
+public:
+  /**
+   * @param glslversion - GLSL version directive matching the ImGui OpenGL backend
+   * @param ringsize - number of pixel buffer objects in the ring
+   * @param allowpersistent - if false, persistent mapping is not used even when supported
+   */
+  TextureStreamer(std::string glslversion, int ringsize = 3, bool allowpersistent = true);
+
+  /**
+   * Releases OpenGL objects
+   */
+  ~TextureStreamer();
+
+  /**
+   * Uploads the frame into the textures, reallocating storage if the frame size or format changed.
+   * Requires current OpenGL context.
+   *
+   * @param frame decoded frame
+   * @param format pixel layout of the frame
+   */
+  void upload(const cv::Mat& frame, PixelFormat format);
+
+  /**
+   * Adds the last uploaded frame to the draw list, converted to RGB by the shader.
+   *
+   * @param drawlist draw list of the window the frame is drawn in
+   * @param upperleft upper left corner of the frame on the screen
+   * @param lowerright lower right corner of the frame on the screen
+   */
+  void draw(ImDrawList* drawlist, ImVec2 upperleft, ImVec2 lowerright);
+
+  /**
+   * Tells if pixel buffers are persistently mapped.
+   *
+   * @return true if persistent mapping is used
+   */
+  bool isPersistent() const;
+
+  /**
+   * Deletes all OpenGL objects, requires current OpenGL context
+   */
+  void release();
+
+private:
+  struct PixelBuffer
+  {
+    GLuint buffer = 0;
+    void* mapped = nullptr;
+    GLsync fence = nullptr;
+  };
+
+  struct Plane
+  {
+    GLuint texture = 0;
+    cv::Size size;
+    GLenum internalformat;
+    GLenum format;
+    size_t offset;
+  };
+
+  void allocate(cv::Size size, PixelFormat format, size_t framebytes);
+  void releaseTextures();
+  void waitForBuffer(PixelBuffer& pixelbuffer);
+  void createProgram();
+  void bindProgram();
+
+  static void drawCallback(const ImDrawList* drawlist, const ImDrawCmd* command);
+
+  std::string glslversion;
+  int ringsize;
+  bool allowpersistent;
+  bool persistent = false;
+
+  cv::Size picturesize {0, 0};
+  PixelFormat pixelformat = PixelFormat::BGR;
+  std::vector<Plane> planes;
+
+  size_t buffersize = 0;
+  std::vector<PixelBuffer> ring;
+  size_t nextbuffer = 0;
+
+  GLuint program = 0;
+  GLint projectionlocation = -1;
+  GLint formatlocation = -1;
+  GLint positionlocation = -1;
+  GLint uvlocation = -1;
+};
+
+#endif
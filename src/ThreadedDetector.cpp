@@ -0,0 +1,451 @@
+#include "ThreadedDetector.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+#include "ClassFilter.hpp"
+#include "Profiler.hpp"
+#include "Tracer.hpp"
+
+ThreadedDetector::ThreadedDetector(std::string& cfgfile, std::string& weightsfile, bool letterbox, PixelFormat format, int batchsize, const std::string& cachedirectory) :
+  ThreadedDetector(cfgfile, weightsfile, letterbox, format, batchsize, cachedirectory, std::chrono::steady_clock::now())
+{}
+
+ThreadedDetector::ThreadedDetector(std::string& cfgfile, std::string& weightsfile, bool letterbox, PixelFormat format, int batchsize, const std::string& cachedirectory,
+    std::chrono::steady_clock::time_point start) :
+  detector(cachedirectory == "" ? std::make_unique<Detector>(cfgfile, weightsfile, 0, std::max(batchsize, 1)) : nullptr),
+  sharednetwork(cachedirectory == "" ? nullptr : std::make_unique<SharedNetwork>(std::make_shared<const NetworkWeights>(cfgfile, weightsfile, cachedirectory))),
+  streams(1),
+  networksize(detector ? cv::Size(detector->get_net_width(), detector->get_net_height()) : sharednetwork->getNetworkSize()),
+  networkinput(networksize, detector ? batchsize : 1),
+  letterbox(letterbox),
+  pixelformat(format)
+{
+  if (sharednetwork && batchsize > 1)
+  {
+    throw std::runtime_error("Batched inference is not supported with the weights cache");
+  }
+  // measured the same way with and without the weights cache, so that cold and warm starts compare directly
+  std::cout << "Network loaded in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+    << " ms" << std::endl;
+  std::cout << "Using " << networkinput.kernelName() << " preprocessing kernel for "
+    << networksize.width << " x " << networksize.height << " network input" << std::endl;
+}
+
+ThreadedDetector::ThreadedDetector(std::shared_ptr<const NetworkWeights> weights, bool letterbox, PixelFormat format) :
+  sharednetwork(std::make_unique<SharedNetwork>(weights)),
+  streams(1),
+  networksize(sharednetwork->getNetworkSize()),
+  networkinput(networksize),
+  letterbox(letterbox),
+  pixelformat(format)
+{}
+
+uint64_t ThreadedDetector::setFrame(const cv::Mat& newframe, int stream)
+{
+  TripleBuffer<cv::Mat>& framebuffer = streams[stream].framebuffer;
+  newframe.copyTo(framebuffer.writeBuffer());
+  uint64_t sequence = framebuffer.publish();
+  {
+    // empty critical section orders the publication with a waiter checking its predicate
+    std::lock_guard<std::mutex> guard(wakeupmutex);
+  }
+  wakeupcondition.notify_one();
+  return sequence;
+}
+
+bool ThreadedDetector::hasPendingFrame() const
+{
+  for (const StreamSlot& slot : streams)
+  {
+    if (slot.framebuffer.hasNewData())
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+int ThreadedDetector::selectStream()
+{
+  int count = streamCount();
+  int selected = -1;
+  for (int offset = 1; offset <= count; offset++)
+  {
+    int index = (laststream + offset) % count;
+    StreamSlot& slot = streams[index];
+    if (!slot.framebuffer.hasNewData())
+    {
+      continue;
+    }
+    // a stream that was idle starts at the current virtual time instead of catching up
+    slot.pass = std::max(slot.pass, virtualtime);
+    if (selected < 0 || slot.pass < streams[selected].pass)
+    {
+      selected = index;
+    }
+  }
+  if (selected >= 0)
+  {
+    virtualtime = streams[selected].pass;
+    streams[selected].pass += 1.0 / streams[selected].priority;
+    laststream = selected;
+  }
+  return selected;
+}
+
+cv::Mat& ThreadedDetector::waitForFrame(uint64_t& sequence, int& stream)
+{
+  ScopedTimer timer(Stage::HandoffWait);
+  std::unique_lock<std::mutex> lock(wakeupmutex);
+  wakeupcondition.wait(lock, [this] { return !running || hasPendingFrame(); });
+  lock.unlock();
+  stream = std::max(selectStream(), 0);
+  TripleBuffer<cv::Mat>& framebuffer = streams[stream].framebuffer;
+  framebuffer.update();
+  sequence = framebuffer.readSequence();
+  return framebuffer.readBuffer();
+}
+
+void ThreadedDetector::setDetectedObjects(std::vector<bbox_t> detected, uint64_t sequence, int stream)
+{
+  std::lock_guard<std::mutex> guard(detectedobjectsmutex);
+  streams[stream].detectedobjects.objects = std::move(detected);
+  streams[stream].detectedobjects.sequence = sequence;
+}
+
+Detections ThreadedDetector::getDetectedObjects(int stream)
+{
+  std::lock_guard<std::mutex> guard(detectedobjectsmutex);
+  return streams[stream].detectedobjects;
+}
+
+void ThreadedDetector::getDetectedObjects(Detections& detections, int stream)
+{
+  std::lock_guard<std::mutex> guard(detectedobjectsmutex);
+  detections.objects.assign(streams[stream].detectedobjects.objects.begin(), streams[stream].detectedobjects.objects.end());
+  detections.sequence = streams[stream].detectedobjects.sequence;
+}
+
+void ThreadedDetector::setStreams(const std::vector<int>& priorities)
+{
+  if (running)
+  {
+    throw std::runtime_error("Streams cannot be changed while the detection thread is running");
+  }
+  streams.clear();
+  for (int priority : priorities)
+  {
+    streams.emplace_back();
+    streams.back().priority = std::max(priority, 1);
+  }
+  if (streams.empty())
+  {
+    streams.emplace_back();
+  }
+  laststream = streamCount() - 1;
+  virtualtime = 0.0;
+}
+
+int ThreadedDetector::streamCount() const
+{
+  return static_cast<int>(streams.size());
+}
+
+size_t ThreadedDetector::queueDepth()
+{
+  size_t pending = 0;
+  for (const StreamSlot& slot : streams)
+  {
+    pending += slot.framebuffer.hasNewData() ? 1 : 0;
+  }
+  return pending;
+}
+
+bool ThreadedDetector::isRunning()
+{
+  return running;
+}
+
+void ThreadedDetector::startThread()
+{
+  running = true;
+  thr = std::thread([this] { this->detectLoop(); });
+}
+
+InputTransform ThreadedDetector::preprocess(const cv::Mat& frame, int slot)
+{
+  ScopedTimer timer(Stage::Preprocess);
+  return networkinput.fill(frame, pixelformat, letterbox, slot);
+}
+
+std::vector<bbox_t> ThreadedDetector::infer(const InputTransform& transform)
+{
+  if (batchSize() > 1)
+  {
+    // detectBatch() sets the network batch to the number of images passed, so only this image is read
+    return inferBatch({transform}).front();
+  }
+  updatePostprocessing();
+  std::vector<bbox_t> detected = runNetwork(transform);
+  suppress(detected);
+  return detected;
+}
+
+std::vector<std::vector<bbox_t>> ThreadedDetector::inferBatch(const std::vector<InputTransform>& transforms)
+{
+  if (transforms.empty() || static_cast<int>(transforms.size()) > batchSize())
+  {
+    throw std::runtime_error("Number of frames does not match the batch size of the network");
+  }
+  updatePostprocessing();
+  std::vector<std::vector<bbox_t>> detected = runNetworkBatch(transforms);
+  for (std::vector<bbox_t>& objects : detected)
+  {
+    suppress(objects);
+  }
+  return detected;
+}
+
+std::vector<bbox_t> ThreadedDetector::detect(const cv::Mat& frame)
+{
+  updatePostprocessing();
+  // planar YUV frames cannot be cropped as a view, so they are passed whole and only filtered
+  if ((activeregions.empty() && !activetiling.enabled()) || pixelformat != PixelFormat::BGR)
+  {
+    std::vector<bbox_t> detected = infer(preprocess(frame));
+    discardOutsideRegions(detected);
+    return detected;
+  }
+
+  if (frame.size() != cropframesize)
+  {
+    activecrops.clear();
+    for (const cv::Rect& crop : activeregions.crops(frame.size()))
+    {
+      appendTiles(crop, activetiling, networksize, activecrops);
+    }
+    cropframesize = frame.size();
+  }
+  std::vector<bbox_t> detected;
+  std::vector<CropTiming> timings;
+  std::vector<InputTransform> transforms;
+  for (size_t first = 0; first < activecrops.size(); first += batchSize())
+  {
+    size_t count = std::min(activecrops.size() - first, static_cast<size_t>(batchSize()));
+    auto starttime = std::chrono::steady_clock::now();
+    transforms.clear();
+    for (size_t slot = 0; slot < count; slot++)
+    {
+      transforms.push_back(preprocess(frame(activecrops[first + slot]), static_cast<int>(slot)));
+    }
+    std::vector<std::vector<bbox_t>> results = batchSize() > 1
+      ? runNetworkBatch(transforms)
+      : std::vector<std::vector<bbox_t>>{runNetwork(transforms.front())};
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - starttime).count();
+    for (size_t slot = 0; slot < count; slot++)
+    {
+      const cv::Rect& crop = activecrops[first + slot];
+      for (bbox_t object : results[slot])
+      {
+        object.x += crop.x;
+        object.y += crop.y;
+        detected.push_back(object);
+      }
+      timings.push_back({crop, elapsed / count});
+    }
+  }
+  discardOutsideRegions(detected);
+  // boxes of objects cut by overlapping crops or tiles are merged by the suppression across all crops,
+  // which darknet's suppression inside every crop cannot do
+  if (activenms.enabled)
+  {
+    suppress(detected);
+  }
+  else
+  {
+    ScopedTimer timer(Stage::Nms);
+    suppression.run(detected, NmsSettings());
+  }
+  {
+    std::lock_guard<std::mutex> guard(detectedobjectsmutex);
+    croptimings = timings;
+  }
+  return detected;
+}
+
+std::vector<bbox_t> ThreadedDetector::runNetwork(const InputTransform& transform)
+{
+  std::vector<bbox_t> detected;
+  {
+    ScopedTimer timer(Stage::Inference);
+    if (sharednetwork)
+    {
+      detected = sharednetwork->detect(networkinput.image(), detectionthreshold, activeclassmask);
+    }
+    else
+    {
+      detected = detector->detect(networkinput.image(), detectionthreshold);
+      applyClassMask(detected);
+    }
+  }
+  for (bbox_t& object : detected)
+  {
+    object = transform.toSource(object);
+  }
+  return detected;
+}
+
+std::vector<std::vector<bbox_t>> ThreadedDetector::runNetworkBatch(const std::vector<InputTransform>& transforms)
+{
+  std::vector<std::vector<bbox_t>> detected;
+  {
+    ScopedTimer timer(Stage::Inference);
+    detected = detector->detectBatch(
+        networkinput.image(), transforms.size(), networksize.width, networksize.height, detectionthreshold, !activenms.enabled);
+  }
+  for (size_t slot = 0; slot < detected.size(); slot++)
+  {
+    applyClassMask(detected[slot]);
+    for (bbox_t& object : detected[slot])
+    {
+      object = transforms[slot].toSource(object);
+    }
+  }
+  return detected;
+}
+
+void ThreadedDetector::setClassMask(const std::vector<uint64_t>& mask)
+{
+  std::lock_guard<std::mutex> guard(postprocessingmutex);
+  pendingclassmask = mask;
+  postprocessingchanged = true;
+}
+
+void ThreadedDetector::setNmsSettings(const NmsSettings& settings)
+{
+  std::lock_guard<std::mutex> guard(postprocessingmutex);
+  pendingnms = settings;
+  postprocessingchanged = true;
+}
+
+void ThreadedDetector::setRegions(const RegionsOfInterest& regions)
+{
+  std::lock_guard<std::mutex> guard(postprocessingmutex);
+  pendingregions = regions;
+  postprocessingchanged = true;
+}
+
+void ThreadedDetector::setTiling(const TilingSettings& settings)
+{
+  std::lock_guard<std::mutex> guard(postprocessingmutex);
+  pendingtiling = settings;
+  postprocessingchanged = true;
+}
+
+void ThreadedDetector::getCropTimings(std::vector<CropTiming>& timings)
+{
+  std::lock_guard<std::mutex> guard(detectedobjectsmutex);
+  timings.assign(croptimings.begin(), croptimings.end());
+}
+
+void ThreadedDetector::updatePostprocessing()
+{
+  if (!postprocessingchanged)
+  {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(postprocessingmutex);
+  activeclassmask = pendingclassmask;
+  activenms = pendingnms;
+  activeregions = pendingregions;
+  activetiling = pendingtiling;
+  cropframesize = cv::Size(0, 0);
+  if (activeregions.empty() && !activetiling.enabled())
+  {
+    std::lock_guard<std::mutex> timingsguard(detectedobjectsmutex);
+    croptimings.clear();
+  }
+  postprocessingchanged = false;
+  // darknet's suppression would remove boxes before the configurable one sees them
+  float nms = activenms.enabled ? 0.0f : darknetnms;
+  if (detector)
+  {
+    detector->nms = nms;
+  }
+  else
+  {
+    sharednetwork->nms = nms;
+  }
+}
+
+void ThreadedDetector::applyClassMask(std::vector<bbox_t>& objects) const
+{
+  if (activeclassmask.empty())
+  {
+    return;
+  }
+  objects.erase(std::remove_if(objects.begin(), objects.end(),
+      [this](const bbox_t& object) { return !maskAccepts(activeclassmask, object.obj_id); }), objects.end());
+}
+
+void ThreadedDetector::discardOutsideRegions(std::vector<bbox_t>& objects) const
+{
+  if (activeregions.empty())
+  {
+    return;
+  }
+  objects.erase(std::remove_if(objects.begin(), objects.end(),
+      [this](const bbox_t& object) { return !activeregions.contains(object); }), objects.end());
+}
+
+void ThreadedDetector::suppress(std::vector<bbox_t>& objects)
+{
+  if (!activenms.enabled)
+  {
+    return;
+  }
+  ScopedTimer timer(Stage::Nms);
+  suppression.run(objects, activenms);
+}
+
+int ThreadedDetector::batchSize() const
+{
+  return networkinput.batchSize();
+}
+
+void ThreadedDetector::detectLoop()
+{
+  Tracer::nameThread("detector");
+  while(running)
+  {
+    uint64_t sequence;
+    int stream;
+    cv::Mat& frame = waitForFrame(sequence, stream);
+    if(!running)
+    {
+      break;
+    }
+    auto starttime = std::chrono::steady_clock::now();
+    if(!frame.empty())
+    {
+      setDetectedObjects(detect(frame), sequence, stream);
+    }
+    inferencetime = std::chrono::duration<double>(std::chrono::steady_clock::now() - starttime).count();
+  }
+}
+
+ThreadedDetector::~ThreadedDetector()
+{
+  {
+    std::lock_guard<std::mutex> guard(wakeupmutex);
+    running = false;
+  }
+  wakeupcondition.notify_all();
+  if(thr.joinable())
+  {
+    thr.join();
+  }
+}
@@ -0,0 +1,364 @@
+#ifndef THREADEDDETECTOR_H
+#define THREADEDDETECTOR_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "YoloDetector.hpp"
+
+#include "TripleBuffer.hpp"
+#include "NetworkInput.hpp"
+#include "SharedNetwork.hpp"
+#include "NonMaximumSuppression.hpp"
+#include "RegionsOfInterest.hpp"
+#include "Tiling.hpp"
+
+/**
+ * Detection results along with the sequence number of the frame they were computed on
+ */
+struct Detections
+{
+  uint64_t sequence = 0;
+  std::vector<bbox_t> objects;
+};
+
+/**
+ * Time spent on one crop of the frame when detecting in regions of interest
+ */
+struct CropTiming
+{
+  cv::Rect crop;
+  double inferencetime = 0.0; ///< preprocessing and inference, in seconds
+};
+
+/**
+ * Wrapper for YOLO detector that runs inference in separate thread.
+ *
+ * The detector can serve several streams. Every stream has its own frame buffer and results,
+ * and the detection thread picks the next pending stream with a weighted round-robin,
+ * so the inference rate is shared between streams instead of multiplied by them.
+ */
+class ThreadedDetector
+{
+public:
+ /**
+  * Creates and runs YOLO detector in new thread
+  * @param cfgfile - path to the config file defining model
+  * @param weightsfile - path to the file containing weights
+  * @param letterbox - if true, frames are letterboxed instead of stretched to the network input
+  * @param format - pixel layout of frames passed to setFrame
+  * @param batchsize - number of frames processed by the network at once, see inferBatch
+  * @param cachedirectory - if not empty, weights are mapped from the weights cache in this directory (batch size 1 only)
+  */
+  ThreadedDetector(std::string& cfgfile, std::string& weightsfile, bool letterbox = false, PixelFormat format = PixelFormat::BGR, int batchsize = 1, const std::string& cachedirectory = "");
+
+ /**
+  * Creates YOLO detector using weights shared with other detectors, only activations are allocated
+  * @param weights - weights loaded once for all detectors
+  * @param letterbox - if true, frames are letterboxed instead of stretched to the network input
+  * @param format - pixel layout of frames passed to setFrame
+  */
+  ThreadedDetector(std::shared_ptr<const NetworkWeights> weights, bool letterbox = false, PixelFormat format = PixelFormat::BGR);
+  
+  /**
+   * Stops and destroys running thread 
+   */
+  ~ThreadedDetector();
+
+  /**
+   * Copies the frame into the preallocated write slot, publishes it and wakes up the detection thread.
+   *
+   * Never waits for the detection thread to finish processing.
+   *
+   * @param newframe new decoded frame to detect, in its native resolution
+   * @param stream index of the stream the frame comes from
+   * @return sequence number assigned to the frame, counted per stream
+   */
+  uint64_t setFrame(const cv::Mat& newframe, int stream = 0);
+
+  /**
+   * Updates detection results.
+   *
+   * @param detected found objects
+   * @param sequence sequence number of the frame the objects were found on
+   * @param stream index of the stream the frame comes from
+   */
+  void setDetectedObjects(std::vector<bbox_t> detected, uint64_t sequence, int stream = 0);
+
+  /**
+   * Returns detected objects
+   *
+   * @param stream index of the stream
+   * @return detected objects in source frame coordinates along with the sequence number of their frame
+   */
+  Detections getDetectedObjects(int stream = 0);
+
+  /**
+   * Copies detected objects into the given results, reusing their storage.
+   *
+   * @param detections receives detected objects in source frame coordinates and the sequence number of their frame
+   * @param stream index of the stream
+   */
+  void getDetectedObjects(Detections& detections, int stream = 0);
+
+  /**
+   * Sets the number of streams and their scheduling weights.
+   * Can be called only when the thread is not running.
+   *
+   * A stream with priority 2 gets twice as many inferences as a stream with priority 1
+   * when both always have a pending frame.
+   *
+   * @param priorities weight of every stream, at least 1
+   */
+  void setStreams(const std::vector<int>& priorities);
+
+  /**
+   * Returns the number of streams served by the detector.
+   *
+   * @return 1 unless changed with setStreams()
+   */
+  int streamCount() const;
+
+  /**
+   * Sets the classes kept by the detector (thread-safe).
+   *
+   * The mask is taken by the detection thread before the next inference. Networks loaded with shared
+   * weights drop other classes before non-maximum suppression, so they are not processed further.
+   *
+   * @param mask one bit per class as produced by ClassFilter, empty keeps all classes
+   */
+  void setClassMask(const std::vector<uint64_t>& mask);
+
+  /**
+   * Sets the non-maximum suppression applied to detected objects (thread-safe).
+   *
+   * The settings are taken by the detection thread before the next inference. When enabled,
+   * darknet's own suppression is turned off and replaced with NonMaximumSuppression.
+   *
+   * @param settings suppression parameters
+   */
+  void setNmsSettings(const NmsSettings& settings);
+
+  /**
+   * Sets the regions of interest of the frames detected by the detection thread (thread-safe).
+   *
+   * The network runs only on the crops of the regions, and objects outside them are discarded.
+   * Frames in NV12 or I420 format are passed whole and only the objects are filtered.
+   *
+   * @param regions polygons in source frame pixels, empty uses the whole frame
+   */
+  void setRegions(const RegionsOfInterest& regions);
+
+  /**
+   * Sets the splitting of frames into tiles detected separately (thread-safe).
+   *
+   * Tiles of every region of interest, or of the whole frame, are detected in batches of batchSize()
+   * and their objects are merged with the suppression across all tiles. Frames in NV12 or I420 format are not tiled.
+   *
+   * @param settings number, size and overlap of tiles
+   */
+  void setTiling(const TilingSettings& settings);
+
+  /**
+   * Copies the crops of the last frame detected in regions of interest or tiles along with their inference times.
+   *
+   * @param timings receives one entry per crop, empty when no regions are set
+   */
+  void getCropTimings(std::vector<CropTiming>& timings);
+
+  /**
+   * Resizes the frame into the network input buffer.
+   * Used by the detection thread, can be called directly only when the thread is not running.
+   *
+   * @param frame decoded frame in the layout passed to the constructor
+   * @param slot index of the frame in the batch
+   * @return transform from the network input back to the frame
+   */
+  InputTransform preprocess(const cv::Mat& frame, int slot = 0);
+
+  /**
+   * Runs the network on the preprocessed input.
+   * Used by the detection thread, can be called directly only when the thread is not running.
+   *
+   * @param transform transform returned by preprocess()
+   * @return detected objects in source frame coordinates
+   */
+  std::vector<bbox_t> infer(const InputTransform& transform);
+
+  /**
+   * Preprocesses the frame and detects objects in its regions of interest and tiles, or in the whole frame.
+   * Used by the detection thread, can be called directly only when the thread is not running.
+   *
+   * @param frame decoded frame in the layout passed to the constructor
+   * @return detected objects in source frame coordinates, after suppression across crops
+   */
+  std::vector<bbox_t> detect(const cv::Mat& frame);
+
+  /**
+   * Runs the network once on frames preprocessed into the first transforms.size() slots.
+   * Can be called only when the thread is not running.
+   *
+   * @param transforms transforms returned by preprocess() for consecutive slots, at most batchSize()
+   * @return detected objects of every slot in source frame coordinates
+   */
+  std::vector<std::vector<bbox_t>> inferBatch(const std::vector<InputTransform>& transforms);
+
+  /**
+   * Returns the number of frames the network processes at once.
+   *
+   * @return batch size given to the constructor
+   */
+  int batchSize() const;
+
+  /**
+   * Returns the number of frames waiting for the detection thread (thread-safe).
+   *
+   * @return number of streams with a published frame not taken by the detection thread yet
+   */
+  size_t queueDepth();
+
+  /**
+   * Tells if the detection is running.
+   *
+   * @return true if detection is still running
+   */
+  bool isRunning();
+
+  /**
+   * Starts the detection thread
+   */
+  void startThread();
+  
+  std::atomic<double> inferencetime;
+
+private:
+  /**
+   * Creates the detector and prints the time elapsed since start, see the public constructor
+   */
+  ThreadedDetector(std::string& cfgfile, std::string& weightsfile, bool letterbox, PixelFormat format, int batchsize, const std::string& cachedirectory,
+      std::chrono::steady_clock::time_point start);
+
+  void detectLoop();
+
+  /**
+   * Frame buffer, results and scheduling state of a single stream
+   */
+  struct StreamSlot
+  {
+    TripleBuffer<cv::Mat> framebuffer;
+    Detections detectedobjects;
+    int priority = 1;
+    // virtual time of the stream's next inference, advanced by 1 / priority per inference
+    double pass = 0.0;
+  };
+
+  /**
+   * Blocks until a new frame is published on any stream or the thread is stopped.
+   *
+   * The returned frame is owned by the detection thread until the next call.
+   *
+   * @param sequence sequence number of the returned frame
+   * @param stream index of the stream the frame comes from
+   * @return the newest frame of the selected stream
+   */
+  cv::Mat& waitForFrame(uint64_t& sequence, int& stream);
+
+  /**
+   * Picks the pending stream with the lowest pass, starting after the last served stream on ties.
+   *
+   * @return index of the stream, or -1 if no stream has a pending frame
+   */
+  int selectStream();
+
+  bool hasPendingFrame() const;
+
+  /**
+   * Runs the network on the preprocessed input, without suppression.
+   *
+   * @param transform transform returned by preprocess()
+   * @return detected objects in source frame coordinates
+   */
+  std::vector<bbox_t> runNetwork(const InputTransform& transform);
+
+  /**
+   * Runs the batched network on the preprocessed slots, without suppression.
+   *
+   * @param transforms transforms returned by preprocess() for consecutive slots
+   * @return detected objects of every slot in source frame coordinates
+   */
+  std::vector<std::vector<bbox_t>> runNetworkBatch(const std::vector<InputTransform>& transforms);
+
+  /**
+   * Takes the mask, suppression settings and regions passed since the last inference, if any.
+   */
+  void updatePostprocessing();
+
+  /**
+   * Removes objects of classes rejected by the active class mask.
+   *
+   * @param objects detected objects
+   */
+  void applyClassMask(std::vector<bbox_t>& objects) const;
+
+  /**
+   * Removes objects whose center lies outside the active regions of interest.
+   *
+   * @param objects detected objects
+   */
+  void discardOutsideRegions(std::vector<bbox_t>& objects) const;
+
+  /**
+   * Applies the active non-maximum suppression, if enabled.
+   *
+   * @param objects detected objects, receives the kept ones
+   */
+  void suppress(std::vector<bbox_t>& objects);
+
+  std::mutex wakeupmutex;
+  std::condition_variable wakeupcondition;
+  std::mutex detectedobjectsmutex;
+  std::mutex postprocessingmutex;
+
+  // exactly one of them is set, depending on the constructor
+  std::unique_ptr<Detector> detector;
+  std::unique_ptr<SharedNetwork> sharednetwork;
+  std::thread thr;
+
+  // deque keeps the slots in place, as triple buffers are not movable
+  std::deque<StreamSlot> streams;
+  int laststream = 0;
+  double virtualtime = 0.0;
+  cv::Size networksize;
+  NetworkInput networkinput;
+  bool letterbox;
+  PixelFormat pixelformat;
+  std::vector<uint64_t> pendingclassmask;
+  NmsSettings pendingnms;
+  // set initially, so that darknet's suppression is turned off before the first inference
+  std::atomic<bool> postprocessingchanged = true;
+  std::vector<uint64_t> activeclassmask;
+  NmsSettings activenms;
+  NonMaximumSuppression suppression;
+  RegionsOfInterest pendingregions;
+  RegionsOfInterest activeregions;
+  TilingSettings pendingtiling;
+  TilingSettings activetiling;
+  std::vector<cv::Rect> activecrops;
+  cv::Size cropframesize {0, 0};
+  std::vector<CropTiming> croptimings;
+  const float darknetnms = 0.4f;
+  const float detectionthreshold = 0.2f;
+  std::atomic<bool> running = false;
+};
+
+#endif
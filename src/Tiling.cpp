@@ -0,0 +1,67 @@
+#include "Tiling.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+/**
+ * Computes the length and count of tiles along one side of the area
+ */
+void tileLayout(int length, int networklength, int requestedcount, const TilingSettings& settings, int& tilelength, int& count)
+{
+  float overlap = std::clamp(settings.overlap, 0.0f, 0.9f);
+  if (settings.automatic)
+  {
+    tilelength = std::min(networklength, length);
+    float stride = tilelength * (1.0f - overlap);
+    count = std::max(1, static_cast<int>(std::ceil((length - tilelength) / stride - 0.01f)) + 1);
+  }
+  else
+  {
+    count = std::max(requestedcount, 1);
+    // count tiles, each sharing the overlap with its neighbour, span the whole length
+    tilelength = static_cast<int>(std::ceil(length / (count - (count - 1) * overlap)));
+    tilelength = std::min(tilelength, length);
+  }
+}
+
+int tileStart(int index, int count, int length, int tilelength)
+{
+  return count > 1 ? static_cast<int>(std::lround(static_cast<double>(index) * (length - tilelength) / (count - 1))) : 0;
+}
+
+}
+
+void appendTiles(const cv::Rect& area, const TilingSettings& settings, cv::Size networksize, std::vector<cv::Rect>& tiles)
+{
+  if (!settings.enabled() || area.area() == 0)
+  {
+    tiles.push_back(area);
+    return;
+  }
+  int tilewidth, tileheight, columns, rows;
+  tileLayout(area.width, networksize.width, settings.columns, settings, tilewidth, columns);
+  tileLayout(area.height, networksize.height, settings.rows, settings, tileheight, rows);
+  if (columns * rows == 1)
+  {
+    tiles.push_back(area);
+    return;
+  }
+  if (settings.fullframe)
+  {
+    tiles.push_back(area);
+  }
+  for (int row = 0; row < rows; row++)
+  {
+    for (int column = 0; column < columns; column++)
+    {
+      tiles.emplace_back(
+          area.x + tileStart(column, columns, area.width, tilewidth),
+          area.y + tileStart(row, rows, area.height, tileheight),
+          tilewidth,
+          tileheight);
+    }
+  }
+}
@@ -0,0 +1,51 @@
+#ifndef TILING_H
+#define TILING_H
+
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * Splitting of high resolution frames into overlapping tiles detected separately
+ */
+struct TilingSettings
+{
+  bool automatic = false; ///< if true, tiles have the size of the network input and their number follows from the frame size
+  int columns = 1;        ///< number of tiles across the frame, used when not automatic
+  int rows = 1;           ///< number of tiles down the frame, used when not automatic
+  float overlap = 0.2f;   ///< fraction of the tile size shared with the neighbouring tile
+  bool fullframe = true;  ///< if true, the whole frame is detected too, so that objects larger than a tile are found
+
+  /**
+   * Tells if frames are split into more than one tile.
+   *
+   * @return true if tiling is used
+   */
+  bool enabled() const
+  {
+    return automatic || columns * rows > 1;
+  }
+
+  bool operator==(const TilingSettings& other) const
+  {
+    return automatic == other.automatic && columns == other.columns && rows == other.rows
+      && overlap == other.overlap && fullframe == other.fullframe;
+  }
+
+  bool operator!=(const TilingSettings& other) const
+  {
+    return !(*this == other);
+  }
+};
+
+/**
+ * Appends the tiles covering the area, spread evenly so that the outer tiles touch its borders.
+ *
+ * @param area part of the frame to split
+ * @param settings number and overlap of tiles
+ * @param networksize size of the network input, the tile size in automatic mode
+ * @param tiles receives the tiles, or the area itself if tiling is disabled
+ */
+void appendTiles(const cv::Rect& area, const TilingSettings& settings, cv::Size networksize, std::vector<cv::Rect>& tiles);
+
+#endif
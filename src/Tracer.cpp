@@ -0,0 +1,96 @@
+#include "Tracer.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+Tracer& Tracer::instance()
+{
+  static Tracer tracer;
+  return tracer;
+}
+
+void Tracer::enable(size_t eventsperthread)
+{
+  Tracer& tracer = instance();
+  {
+    std::lock_guard<std::mutex> guard(tracer.registrymutex);
+    tracer.capacity = std::max<size_t>(eventsperthread, 1);
+    tracer.epoch = Profiler::Clock::now();
+  }
+  active.store(true, std::memory_order_release);
+}
+
+Tracer::ThreadEvents& Tracer::threadEvents()
+{
+  thread_local ThreadEvents* events = nullptr;
+  if (!events)
+  {
+    Tracer& tracer = instance();
+    std::lock_guard<std::mutex> guard(tracer.registrymutex);
+    tracer.threads.push_back(std::make_unique<ThreadEvents>());
+    events = tracer.threads.back().get();
+    events->id = static_cast<int>(tracer.threads.size());
+    events->name = "thread " + std::to_string(events->id);
+    events->ring.resize(tracer.capacity);
+  }
+  return *events;
+}
+
+void Tracer::nameThread(const char* name)
+{
+  if (!enabled())
+  {
+    return;
+  }
+  ThreadEvents& events = threadEvents();
+  std::lock_guard<std::mutex> guard(instance().registrymutex);
+  events.name = name;
+}
+
+void Tracer::record(Stage stage, Profiler::Clock::time_point start, Profiler::Clock::time_point end)
+{
+  ThreadEvents& events = threadEvents();
+  uint64_t written = events.written.load(std::memory_order_relaxed);
+  Event& event = events.ring[written % events.ring.size()];
+  event.stage = stage;
+  event.start = std::chrono::duration_cast<std::chrono::nanoseconds>(start - instance().epoch).count();
+  event.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+  events.written.store(written + 1, std::memory_order_release);
+}
+
+void Tracer::write(const std::string& path)
+{
+  Tracer& tracer = instance();
+  std::lock_guard<std::mutex> guard(tracer.registrymutex);
+
+  FILE* file = fopen(path.c_str(), "w");
+  if (!file)
+  {
+    throw std::runtime_error("Failed to open trace file " + path);
+  }
+
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"darknet-demo\"}}");
+  for (const std::unique_ptr<ThreadEvents>& events : tracer.threads)
+  {
+    fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+        events->id, events->name.c_str());
+
+    uint64_t written = events->written.load(std::memory_order_acquire);
+    uint64_t size = events->ring.size();
+    uint64_t first = written > size ? written - size : 0;
+    for (uint64_t i = first; i < written; i++)
+    {
+      const Event& event = events->ring[i % size];
+      fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+          stageName(event.stage), events->id, event.start / 1000.0, event.duration / 1000.0);
+    }
+  }
+  fprintf(file, "\n]}\n");
+
+  if (fclose(file) != 0)
+  {
+    throw std::runtime_error("Failed to write trace file " + path);
+  }
+}
@@ -0,0 +1,92 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Profiler.hpp"
+
+/**
+ * Records stage begin and end times from all threads for Chrome trace export.
+ *
+ * Every thread writes into its own ring buffer, allocated once on its first event,
+ * so recording takes no lock. When a ring is full the oldest events are overwritten.
+ * While tracing is disabled, recording costs a single relaxed atomic load.
+ */
+class Tracer
+{
+public:
+  /**
+   * Starts recording events.
+   *
+   * @param eventsperthread capacity of the ring buffer of each thread
+   */
+  static void enable(size_t eventsperthread = 1 << 16);
+
+  /**
+   * Tells if events are recorded.
+   *
+   * @return true if enable() was called
+   */
+  static bool enabled()
+  {
+    return active.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Sets the name under which the calling thread is shown in the trace.
+   *
+   * @param name thread name
+   */
+  static void nameThread(const char* name);
+
+  /**
+   * Records the stage execution in the ring buffer of the calling thread.
+   *
+   * @param stage executed stage
+   * @param start time the stage began
+   * @param end time the stage ended
+   */
+  static void record(Stage stage, Profiler::Clock::time_point start, Profiler::Clock::time_point end);
+
+  /**
+   * Writes recorded events of all threads as Chrome trace JSON, viewable in chrome://tracing or Perfetto.
+   * Must be called after all recording threads finished.
+   *
+   * @param path output file
+   */
+  static void write(const std::string& path);
+
+private:
+  struct Event
+  {
+    Stage stage;
+    int64_t start;    ///< nanoseconds since enable()
+    int64_t duration; ///< nanoseconds
+  };
+
+  struct ThreadEvents
+  {
+    int id = 0;
+    std::string name;
+    std::vector<Event> ring;
+    std::atomic<uint64_t> written = 0;
+  };
+
+  static Tracer& instance();
+  static ThreadEvents& threadEvents();
+
+  inline static std::atomic<bool> active = false;
+
+  std::mutex registrymutex;
+  std::deque<std::unique_ptr<ThreadEvents>> threads;
+  size_t capacity = 0;
+  Profiler::Clock::time_point epoch;
+};
+
+#endif
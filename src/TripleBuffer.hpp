@@ -0,0 +1,118 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Lock-free single-producer single-consumer triple buffer.
+ *
+ * The writer fills the write slot and publishes it by swapping it with the ready slot,
+ * the reader takes the ready slot by swapping it with its read slot. Neither side ever
+ * waits for the other and the reader never sees a slot that is being written to.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+  /**
+   * Returns the slot owned by the writer.
+   *
+   * @return slot to fill before calling publish()
+   */
+  T& writeBuffer()
+  {
+    return slots[writeindex].value;
+  }
+
+  /**
+   * Makes the write slot available to the reader and takes the ready slot for writing.
+   *
+   * @return sequence number assigned to the published slot
+   */
+  uint64_t publish()
+  {
+    uint64_t sequence = ++writesequence;
+    slots[writeindex].sequence = sequence;
+    uint8_t previous = readystate.exchange(writeindex | freshflag, std::memory_order_acq_rel);
+    writeindex = previous & indexmask;
+    publishedsequence.store(sequence, std::memory_order_release);
+    return sequence;
+  }
+
+  /**
+   * Tells if there is a published slot the reader has not taken yet.
+   *
+   * @return true if update() would return a new slot
+   */
+  bool hasNewData() const
+  {
+    return readystate.load(std::memory_order_acquire) & freshflag;
+  }
+
+  /**
+   * Swaps the read slot with the ready slot if the writer published new data.
+   *
+   * @return true if the read slot changed
+   */
+  bool update()
+  {
+    if (!hasNewData())
+    {
+      return false;
+    }
+    uint8_t previous = readystate.exchange(readindex, std::memory_order_acq_rel);
+    readindex = previous & indexmask;
+    return true;
+  }
+
+  /**
+   * Returns the slot owned by the reader.
+   *
+   * @return slot taken by the last successful update()
+   */
+  T& readBuffer()
+  {
+    return slots[readindex].value;
+  }
+
+  /**
+   * Returns the sequence number of the read slot.
+   *
+   * @return sequence number of the slot taken by the last successful update(), 0 if none
+   */
+  uint64_t readSequence() const
+  {
+    return slots[readindex].sequence;
+  }
+
+  /**
+   * Returns the sequence number of the most recently published slot (thread-safe).
+   *
+   * @return sequence number of the last publish() call
+   */
+  uint64_t lastPublished() const
+  {
+    return publishedsequence.load(std::memory_order_acquire);
+  }
+
+private:
+  struct Slot
+  {
+    T value;
+    uint64_t sequence = 0;
+  };
+
+  static constexpr uint8_t indexmask = 0x3;
+  static constexpr uint8_t freshflag = 0x4;
+
+  std::array<Slot, 3> slots;
+  uint8_t writeindex = 0;
+  uint8_t readindex = 1;
+  std::atomic<uint8_t> readystate = 2;
+  uint64_t writesequence = 0;
+  std::atomic<uint64_t> publishedsequence = 0;
+};
+
+#endif
@@ -0,0 +1,372 @@
+#include "WeightsCache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "darknet.h"
+
+static constexpr char cachemagic[8] = {'D', 'N', 'W', 'C', 'A', 'C', 'H', 'E'};
+static constexpr uint32_t cacheversion = 2;
+static constexpr uint64_t cachealignment = 64;
+static constexpr int arraycount = 5;
+
+struct CacheHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t layers;
+  uint64_t key;
+  uint64_t size;
+};
+
+struct CacheLayer
+{
+  int32_t type;
+  int32_t batchnormalize;
+  int32_t weightsnormalization;
+  int32_t reserved; // keeps the offsets 8-byte aligned
+  uint64_t offsets[arraycount];
+  uint64_t counts[arraycount];
+};
+
+static uint64_t alignOffset(uint64_t offset)
+{
+  return (offset + cachealignment - 1) / cachealignment * cachealignment;
+}
+
+/**
+ * Updates 64-bit FNV-1a hash with the bytes
+ */
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+{
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+/**
+ * Tells if the weights of the layer are stored in the cache
+ */
+static bool cachedLayer(const layer& l)
+{
+  return !l.share_layer && l.weights && (l.type == CONVOLUTIONAL || l.type == SHORTCUT);
+}
+
+/**
+ * Tells if all weights of the network are kept in layers stored in the cache
+ */
+static bool cacheable(const network& net)
+{
+  for (int i = 0; i < net.n; i++)
+  {
+    const layer& l = net.layers[i];
+    if (l.weights && !l.share_layer && !cachedLayer(l))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Returns pointers to the weight arrays of the layer, in the order used by the cache
+ */
+static void layerArrays(layer& l, float** arrays[arraycount])
+{
+  arrays[0] = &l.weights;
+  arrays[1] = &l.biases;
+  arrays[2] = &l.scales;
+  arrays[3] = &l.rolling_mean;
+  arrays[4] = &l.rolling_variance;
+}
+
+/**
+ * Returns the number of floats in every weight array of the layer stored in the cache
+ */
+static void arraySizes(const layer& l, bool batchnormalize, uint64_t sizes[arraycount])
+{
+  std::fill(sizes, sizes + arraycount, 0);
+  if (!cachedLayer(l))
+  {
+    return;
+  }
+  sizes[0] = l.nweights;
+  if (l.type == CONVOLUTIONAL)
+  {
+    sizes[1] = l.n;
+    if (batchnormalize)
+    {
+      sizes[2] = sizes[3] = sizes[4] = l.n;
+    }
+  }
+}
+
+WeightsCache::WeightsCache(const std::string& directory, const std::string& cfgfile, const std::string& weightsfile)
+{
+  std::ifstream cfg(cfgfile, std::ios::binary);
+  std::vector<char> contents((std::istreambuf_iterator<char>(cfg)), std::istreambuf_iterator<char>());
+
+  uint64_t hash = 14695981039346656037ull;
+  hash = hashBytes(hash, &cacheversion, sizeof(cacheversion));
+  hash = hashBytes(hash, contents.data(), contents.size());
+  // the weights file is identified by its metadata, as hashing its contents would read the whole file on every start;
+  // the change time and inode cannot be preserved by cp -p or rsync, so a replaced file gets a new key
+  struct stat weightsstat;
+  if (stat(weightsfile.c_str(), &weightsstat) == 0)
+  {
+    const int64_t metadata[] = {
+      static_cast<int64_t>(weightsstat.st_size),
+      static_cast<int64_t>(weightsstat.st_mtim.tv_sec),
+      static_cast<int64_t>(weightsstat.st_mtim.tv_nsec),
+      static_cast<int64_t>(weightsstat.st_ctim.tv_sec),
+      static_cast<int64_t>(weightsstat.st_ctim.tv_nsec),
+      static_cast<int64_t>(weightsstat.st_ino),
+      static_cast<int64_t>(weightsstat.st_dev)};
+    hash = hashBytes(hash, metadata, sizeof(metadata));
+  }
+  key = hash;
+
+  char name[32];
+  snprintf(name, sizeof(name), "-%016llx.weightscache", static_cast<unsigned long long>(key));
+  cachepath = (std::filesystem::path(directory) / (std::filesystem::path(weightsfile).stem().string() + name)).string();
+}
+
+WeightsCache::~WeightsCache()
+{
+  if (mapping)
+  {
+    munmap(mapping, mappingsize);
+  }
+}
+
+bool WeightsCache::map(network& prototype)
+{
+  int fd = open(cachepath.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return false;
+  }
+  struct stat filestat;
+  if (fstat(fd, &filestat) != 0 || static_cast<size_t>(filestat.st_size) < sizeof(CacheHeader))
+  {
+    close(fd);
+    return false;
+  }
+  size_t size = filestat.st_size;
+  // private writable mapping: pages stay shared with the page cache unless darknet writes to them
+  void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED)
+  {
+    return false;
+  }
+
+  char* base = static_cast<char*>(memory);
+  const CacheHeader* header = reinterpret_cast<const CacheHeader*>(base);
+  const CacheLayer* table = reinterpret_cast<const CacheLayer*>(base + sizeof(CacheHeader));
+  bool valid = std::memcmp(header->magic, cachemagic, sizeof(cachemagic)) == 0
+    && header->version == cacheversion
+    && header->key == key
+    && header->size == size
+    && header->layers == static_cast<uint32_t>(prototype.n)
+    && sizeof(CacheHeader) + prototype.n * sizeof(CacheLayer) <= size;
+  for (int i = 0; valid && i < prototype.n; i++)
+  {
+    const layer& l = prototype.layers[i];
+    uint64_t expected[arraycount];
+    arraySizes(l, true, expected);
+    // fusing clears batch normalization and normalization of shortcut weights, other values must match the cfg file
+    valid = table[i].type == l.type
+      && (table[i].batchnormalize == l.batch_normalize || table[i].batchnormalize == 0)
+      && (table[i].weightsnormalization == l.weights_normalization || table[i].weightsnormalization == NO_NORMALIZATION);
+    for (int a = 0; valid && a < arraycount; a++)
+    {
+      // normalization arrays are absent when batch normalization was fused into the weights
+      bool countmatches = table[i].counts[a] == expected[a] || (a >= 2 && table[i].counts[a] == 0);
+      valid = countmatches
+        && table[i].offsets[a] % cachealignment == 0
+        && table[i].offsets[a] + table[i].counts[a] * sizeof(float) <= size;
+    }
+  }
+  if (!valid)
+  {
+    munmap(memory, size);
+    return false;
+  }
+
+  madvise(memory, size, MADV_WILLNEED);
+  for (int i = 0; i < prototype.n; i++)
+  {
+    layer& l = prototype.layers[i];
+    if (!cachedLayer(l))
+    {
+      continue;
+    }
+    float** arrays[arraycount];
+    layerArrays(l, arrays);
+    for (int a = 0; a < arraycount; a++)
+    {
+      if (table[i].counts[a] > 0)
+      {
+        free(*arrays[a]);
+        *arrays[a] = reinterpret_cast<float*>(base + table[i].offsets[a]);
+      }
+    }
+    l.batch_normalize = table[i].batchnormalize;
+    l.weights_normalization = static_cast<WEIGHTS_NORMALIZATION_T>(table[i].weightsnormalization);
+  }
+  for (int i = 0; i < prototype.n; i++)
+  {
+    // such layers still point to the arrays freed above
+    layer& l = prototype.layers[i];
+    if (l.share_layer)
+    {
+      l.weights = l.share_layer->weights;
+      l.biases = l.share_layer->biases;
+      l.scales = l.share_layer->scales;
+      l.rolling_mean = l.share_layer->rolling_mean;
+      l.rolling_variance = l.share_layer->rolling_variance;
+      l.batch_normalize = l.share_layer->batch_normalize;
+      l.weights_normalization = l.share_layer->weights_normalization;
+    }
+  }
+  mapping = memory;
+  mappingsize = size;
+  return true;
+}
+
+bool WeightsCache::write(const network& prototype)
+{
+  if (!cacheable(prototype))
+  {
+    std::cout << "Weights cache supports only networks with weights in convolutional and shortcut layers" << std::endl;
+    return false;
+  }
+
+  CacheHeader header;
+  std::memcpy(header.magic, cachemagic, sizeof(cachemagic));
+  header.version = cacheversion;
+  header.layers = prototype.n;
+  header.key = key;
+
+  std::vector<CacheLayer> table(prototype.n);
+  uint64_t offset = alignOffset(sizeof(CacheHeader) + prototype.n * sizeof(CacheLayer));
+  for (int i = 0; i < prototype.n; i++)
+  {
+    const layer& l = prototype.layers[i];
+    table[i].type = l.type;
+    table[i].batchnormalize = l.batch_normalize;
+    table[i].weightsnormalization = l.weights_normalization;
+    arraySizes(l, l.batch_normalize, table[i].counts);
+    for (int a = 0; a < arraycount; a++)
+    {
+      table[i].offsets[a] = offset;
+      offset = alignOffset(offset + table[i].counts[a] * sizeof(float));
+    }
+  }
+  header.size = offset;
+
+  std::error_code error;
+  std::filesystem::create_directories(std::filesystem::path(cachepath).parent_path(), error);
+  // unique name, so that processes started at the same time do not write into the same file
+  std::string temporarypath = cachepath + ".XXXXXX";
+  int fd = mkstemp(&temporarypath[0]);
+  FILE* file = fd >= 0 ? fdopen(fd, "wb") : nullptr;
+  if (!file)
+  {
+    std::cout << "Failed to create weights cache " << temporarypath << std::endl;
+    if (fd >= 0)
+    {
+      close(fd);
+      remove(temporarypath.c_str());
+    }
+    return false;
+  }
+  // mkstemp creates the file readable by the owner only
+  fchmod(fd, 0644);
+
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1
+    && fwrite(table.data(), sizeof(CacheLayer), table.size(), file) == table.size();
+  const char padding[cachealignment] = {};
+  uint64_t position = sizeof(CacheHeader) + prototype.n * sizeof(CacheLayer);
+  for (int i = 0; written && i < prototype.n; i++)
+  {
+    float** arrays[arraycount];
+    layerArrays(prototype.layers[i], arrays);
+    for (int a = 0; written && a < arraycount; a++)
+    {
+      if (table[i].counts[a] == 0)
+      {
+        continue;
+      }
+      written = fwrite(padding, 1, table[i].offsets[a] - position, file) == table[i].offsets[a] - position
+        && fwrite(*arrays[a], sizeof(float), table[i].counts[a], file) == table[i].counts[a];
+      position = table[i].offsets[a] + table[i].counts[a] * sizeof(float);
+    }
+  }
+  written = written && fwrite(padding, 1, header.size - position, file) == header.size - position;
+  written = fclose(file) == 0 && written;
+
+  if (!written || rename(temporarypath.c_str(), cachepath.c_str()) != 0)
+  {
+    std::cout << "Failed to write weights cache " << cachepath << std::endl;
+    remove(temporarypath.c_str());
+    return false;
+  }
+  return true;
+}
+
+void WeightsCache::detach(network& prototype)
+{
+  if (!mapping)
+  {
+    return;
+  }
+  char* begin = static_cast<char*>(mapping);
+  char* end = begin + mappingsize;
+  for (int i = 0; i < prototype.n; i++)
+  {
+    float** arrays[arraycount];
+    layerArrays(prototype.layers[i], arrays);
+    for (int a = 0; a < arraycount; a++)
+    {
+      char* array = reinterpret_cast<char*>(*arrays[a]);
+      if (array >= begin && array < end)
+      {
+        *arrays[a] = nullptr;
+      }
+    }
+  }
+}
+
+const std::string& WeightsCache::path() const
+{
+  return cachepath;
+}
+
+std::string WeightsCache::defaultDirectory()
+{
+  const char* cachehome = getenv("XDG_CACHE_HOME");
+  if (cachehome && cachehome[0] != '\0')
+  {
+    return std::string(cachehome) + "/darknet-demo";
+  }
+  const char* home = getenv("HOME");
+  return std::string(home ? home : ".") + "/.cache/darknet-demo";
+}
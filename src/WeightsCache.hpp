@@ -0,0 +1,85 @@
+#ifndef WEIGHTSCACHE_H
+#define WEIGHTSCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct network;
+
+/**
+ * Cache of fused network weights stored in a file that can be memory-mapped directly.
+ *
+ * The file holds the weight arrays of a loaded and fused network, each aligned to 64 bytes,
+ * along with the normalization flags of every layer cleared by fusing, so a later start only parses the cfg file and points the layers into the mapping
+ * instead of reading and converting the original weights file.
+ * The file name contains a hash of the cfg contents and of the size, modification time, change time
+ * and inode of the weights file. The weights are not hashed, as that would read the whole file on every
+ * start; the change time and inode are set by the kernel when the file is written or replaced, so they
+ * catch replacements that keep the size and modification time, such as cp -p or rsync.
+ */
+class WeightsCache
+{
+public:
+  /**
+   * Computes the cache file path for the model, does not touch the file
+   * @param directory - directory holding cache files, created when the cache is written
+   * @param cfgfile - path to the config file defining model
+   * @param weightsfile - path to the file containing weights
+   */
+  WeightsCache(const std::string& directory, const std::string& cfgfile, const std::string& weightsfile);
+
+  /**
+   * Unmaps the cache file, arrays of the network pointing into it have to be detached first
+   */
+  ~WeightsCache();
+
+  WeightsCache(const WeightsCache&) = delete;
+  WeightsCache& operator=(const WeightsCache&) = delete;
+
+  /**
+   * Maps the cache file and points the weight arrays of the freshly parsed network into it.
+   *
+   * @param prototype network parsed from the cfg file, without loaded weights
+   * @return false if the cache file is missing or does not match the network
+   */
+  bool map(network& prototype);
+
+  /**
+   * Writes weight arrays of the loaded and fused network to the cache file.
+   * Failures are reported on the standard output and leave no partial file behind.
+   *
+   * @param prototype network with loaded and fused weights
+   * @return true if the cache file was written
+   */
+  bool write(const network& prototype);
+
+  /**
+   * Clears pointers of the network into the mapping, so that free_network does not free them.
+   *
+   * @param prototype network previously passed to map()
+   */
+  void detach(network& prototype);
+
+  /**
+   * Returns the path of the cache file.
+   *
+   * @return cache file path
+   */
+  const std::string& path() const;
+
+  /**
+   * Returns the default cache directory, $XDG_CACHE_HOME/darknet-demo or ~/.cache/darknet-demo.
+   *
+   * @return directory path
+   */
+  static std::string defaultDirectory();
+
+private:
+  std::string cachepath;
+  uint64_t key = 0;
+  void* mapping = nullptr;
+  size_t mappingsize = 0;
+};
+
+#endif
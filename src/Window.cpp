@@ -51,6 +51,10 @@ float Window::getContentAspectRatio(void)
   return contentaspectratio;
 }
 
+const char* Window::getGlslVersion(void)
+{
+  return glslversion;
+}
 
 // Private functions:
 
@@ -163,6 +167,10 @@ void Window::setFullScreen(bool fullscreen)
 
 Window::~Window()
 {
+  if (window == nullptr)
+  {
+    return;
+  }
   ImGui_ImplOpenGL3_Shutdown();
   ImGui_ImplGlfw_Shutdown();
   ImGui::DestroyContext();
@@ -49,6 +49,12 @@ class Window
     float getContentAspectRatio(void);
 
     void setFullScreen(bool fullscreen);
+
+    /**
+     * Returns GLSL version directive used by the ImGui OpenGL backend
+     * @return version directive to prepend to shaders
+     */
+    const char* getGlslVersion(void);
   
   private:
     GLFWmonitor *monitor = nullptr;
@@ -0,0 +1,14 @@
+#ifndef YOLODETECTOR_H
+#define YOLODETECTOR_H
+
+/**
+ * darknet's Detector API with its OpenCV helpers enabled; include this header instead of yolo_v2_class.hpp,
+ * so that OPENCV is defined once and builds passing -DOPENCV do not redefine it.
+ */
+
+#ifndef OPENCV
+#define OPENCV
+#endif
+#include "yolo_v2_class.hpp"
+
+#endif
@@ -7,7 +7,6 @@ int main(int argc, char *argv[])
   {
       return EXIT_FAILURE;
   } 
-  vis.run();
-  return EXIT_SUCCESS;
+  return vis.run();
 }
 
@@ -0,0 +1,116 @@
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "SharedNetwork.hpp"
+
+/**
+ * Checks that a network running on weights mapped from the weights cache detects exactly
+ * what the network running on the weights it was written from detects.
+ *
+ * Usage: weights-cache-test <cfg file> <weights file>
+ */
+
+namespace
+{
+
+/**
+ * Detects with every threshold and suppression disabled, so that all outputs of the network are compared
+ */
+std::vector<bbox_t> detectAll(SharedNetwork& network, std::vector<float>& input)
+{
+  cv::Size size = network.getNetworkSize();
+  image_t image {size.height, size.width, 3, input.data()};
+  network.nms = 0.0f;
+  return network.detect(image, 0.0f);
+}
+
+bool sameDetections(const std::vector<bbox_t>& expected, const std::vector<bbox_t>& actual, const std::string& name)
+{
+  if (expected.size() != actual.size())
+  {
+    std::cout << name << ": " << actual.size() << " objects instead of " << expected.size() << std::endl;
+    return false;
+  }
+  for (size_t i = 0; i < expected.size(); i++)
+  {
+    const bbox_t& e = expected[i];
+    const bbox_t& a = actual[i];
+    if (e.x != a.x || e.y != a.y || e.w != a.w || e.h != a.h || e.obj_id != a.obj_id || std::fabs(e.prob - a.prob) > 1e-5f)
+    {
+      std::cout << name << ": object " << i << " differs, class " << a.obj_id << " probability " << a.prob
+        << " instead of class " << e.obj_id << " probability " << e.prob << std::endl;
+      return false;
+    }
+  }
+  std::cout << name << ": " << actual.size() << " objects match" << std::endl;
+  return true;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  if (argc != 3)
+  {
+    std::cout << "Usage: " << argv[0] << " <cfg file> <weights file>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::string cfgfile = argv[1];
+  std::string weightsfile = argv[2];
+
+  std::string directory = (std::filesystem::temp_directory_path() / "weights-cache-test-XXXXXX").string();
+  if (!mkdtemp(&directory[0]))
+  {
+    std::cout << "Failed to create a temporary cache directory" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  bool passed = false;
+  try
+  {
+    std::vector<float> input;
+    std::vector<bbox_t> cold;
+    {
+      // cold cache: the weights file is read and fused, then written to the cache
+      auto weights = std::make_shared<const NetworkWeights>(cfgfile, weightsfile, directory);
+      SharedNetwork network(weights);
+      cv::Size size = network.getNetworkSize();
+      std::mt19937 generator(42);
+      std::uniform_real_distribution<float> values(0.0f, 1.0f);
+      input.resize(static_cast<size_t>(size.width) * size.height * 3);
+      for (float& value : input)
+      {
+        value = values(generator);
+      }
+      cold = detectAll(network, input);
+    }
+    if (std::filesystem::is_empty(directory))
+    {
+      std::cout << "Weights cache was not written" << std::endl;
+    }
+    else
+    {
+      // warm cache: the first instance runs on the mapped prototype, the second parses the cfg file again
+      auto weights = std::make_shared<const NetworkWeights>(cfgfile, weightsfile, directory);
+      SharedNetwork prototype(weights);
+      SharedNetwork instance(weights);
+      passed = sameDetections(cold, detectAll(prototype, input), "warm prototype")
+        && sameDetections(cold, detectAll(instance, input), "warm shared instance");
+    }
+  }
+  catch (std::exception& error)
+  {
+    std::cout << error.what() << std::endl;
+  }
+
+  std::error_code error;
+  std::filesystem::remove_all(directory, error);
+  std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}